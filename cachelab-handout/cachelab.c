@@ -11,6 +11,8 @@
 
 shift_funct_t func_list[MAX_SHIFT_FUNCS];
 int func_counter = 0;
+scratch_buf_t scratch_list[MAX_SCRATCH_BUFS];
+int scratch_counter = 0;
 
 /*
  * printSummary - Summarize the cache simulation statistics. Student cache
@@ -27,19 +29,118 @@ void printSummary(int hits, int misses, int evictions)
 }
 
 /*
- * initMatrix - Initialize the given matrix with random values [0, 999].
+ * mix64 - The splitmix64 finalizer, a cheap bijective 64-bit hash.
  */
-void initMatrix(int M, int N, int A[M][N])
+static inline unsigned long long int mix64(unsigned long long int x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/*
+ * cellValue - Hash a flat index under a seed key into [0, 999]. This is
+ *             the lowbias32 mixer on 32-bit lanes, so the fill loop below
+ *             vectorizes; 64-bit multiplies would not.
+ */
+static inline int cellValue(unsigned int key, unsigned int idx)
+{
+    unsigned int x = idx * 0x9e3779b9u + key;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return (int) (x % 1000);
+}
+
+/*
+ * seedKey - The per-seed key mixed into every cell.
+ */
+static inline unsigned int seedKey(unsigned int seed)
+{
+    return (unsigned int) (mix64(seed) >> 32);
+}
+
+/*
+ * matrixValue - The value initMatrix() stores at flat index idx for the
+ *               given seed, in [0, 999]. Being a pure function of
+ *               (seed, idx), any element can be recomputed on its own.
+ */
+int matrixValue(unsigned int seed, unsigned int idx)
+{
+    return cellValue(seedKey(seed), idx);
+}
+
+/*
+ * initMatrix - Initialize the given matrix with pseudo-random values
+ *              [0, 999] determined by seed. Elements are independent of
+ *              each other and the hash is inlined, so the inner loop has
+ *              no calls or carried state and can be vectorized.
+ */
+void initMatrix(int M, int N, int A[M][N], unsigned int seed)
 {
     int i, j;
-    srand(time(NULL));
+    unsigned int key = seedKey(seed);
+    unsigned int row;
     for (i = 0; i < M; i++){
+        row = (unsigned int) (i * N);
         for (j = 0; j < N; j++){
-            A[i][j] = rand()%1000;
+            A[i][j] = cellValue(key, row + (unsigned int) j);
         }
     }
 }
 
+/*
+ * cellHash - Hash of one element and its position, summed by the
+ *            checksums below so that misplaced values are detected.
+ */
+static unsigned long long int cellHash(unsigned int idx, int value)
+{
+    return mix64(((unsigned long long int) idx << 32) | (unsigned int) value);
+}
+
+/*
+ * matrixChecksum - Checksum of the contents of A.
+ */
+unsigned long long int matrixChecksum(int M, int N, int A[M][N])
+{
+    int i, j;
+    unsigned long long int sum = 0;
+    for (i = 0; i < M; i++)
+        for (j = 0; j < N; j++)
+            sum += cellHash((unsigned int) (i * N + j), A[i][j]);
+    return sum;
+}
+
+/*
+ * expectedValue - The value A[i][j] should hold after a matrix filled by
+ *                 initMatrix(M, N, A, seed) has been shifted `shifts`
+ *                 times, i.e. its rows rotated up by shifts.
+ */
+int expectedValue(int M, int N, unsigned int seed, int shifts, int i, int j)
+{
+    return matrixValue(seed, (unsigned int) (((i + shifts) % M) * N + j));
+}
+
+/*
+ * expectedChecksum - matrixChecksum() of the shifted matrix, computed
+ *                    from the seed alone without materializing it.
+ */
+unsigned long long int expectedChecksum(int M, int N, unsigned int seed, int shifts)
+{
+    int i, j;
+    unsigned long long int sum = 0;
+    for (i = 0; i < M; i++)
+        for (j = 0; j < N; j++)
+            sum += cellHash((unsigned int) (i * N + j),
+                            expectedValue(M, N, seed, shifts, i, j));
+    return sum;
+}
+
 /*
  * randMatrix - Generates a random matrix with the specified dimensions.
  */
@@ -86,3 +187,85 @@ void registerShiftFunction(void (*shift)(int M, int N, int[M][N], int s, int E,
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/*
+ * registerScratchBuffer - Tell tracegen about a buffer (other than the
+ *                         matrix itself) that a shift function reads or
+ *                         writes, so that its accesses are not filtered
+ *                         out of the trace. Registering the same buffer
+ *                         twice is harmless.
+ */
+void registerScratchBuffer(void* base, unsigned long long int len, char* desc)
+{
+    int i;
+    for (i = 0; i < scratch_counter; i++) {
+        if (scratch_list[i].base == base && scratch_list[i].len >= len)
+            return;
+        if (scratch_list[i].base == base) {
+            scratch_list[i].len = len;
+            return;
+        }
+    }
+    assert(scratch_counter < MAX_SCRATCH_BUFS);
+    scratch_list[scratch_counter].base = base;
+    scratch_list[scratch_counter].len = len;
+    scratch_list[scratch_counter].description = desc;
+    scratch_counter++;
+}
+
+/*
+ * simCacheInit - Allocate an empty LRU cache. Its replacement policy is
+ *                the same as csim-ref, so scores are comparable with the
+ *                misses test-shift reports.
+ */
+void simCacheInit(sim_cache_t *c, int s, int E, int b)
+{
+    int lines = (1 << s) * E;
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    c->tags = calloc(lines, sizeof(*c->tags));
+    c->stamp = calloc(lines, sizeof(*c->stamp));
+    assert(c->tags && c->stamp);
+    c->clock = 0;
+    c->hits = c->misses = c->evictions = 0;
+}
+
+/*
+ * simCacheAccess - Look up addr, filling the least recently used line of
+ *                  its set on a miss.
+ */
+void simCacheAccess(sim_cache_t *c, unsigned long long int addr)
+{
+    unsigned long long int block = addr >> c->b;
+    unsigned long long int tag = block >> c->s;
+    int set = (int) (block & ((1ULL << c->s) - 1));
+    unsigned long long int *tags = c->tags + set * c->E;
+    unsigned long long int *stamp = c->stamp + set * c->E;
+    int i, victim = 0;
+
+    c->clock++;
+    for (i = 0; i < c->E; i++) {
+        if (stamp[i] && tags[i] == tag) {
+            stamp[i] = c->clock;
+            c->hits++;
+            return;
+        }
+        if (stamp[i] < stamp[victim])
+            victim = i;
+    }
+    c->misses++;
+    if (stamp[victim])
+        c->evictions++;
+    tags[victim] = tag;
+    stamp[victim] = c->clock;
+}
+
+/*
+ * simCacheFree - Release a simulated cache.
+ */
+void simCacheFree(sim_cache_t *c)
+{
+    free(c->tags);
+    free(c->stamp);
+}
@@ -6,7 +6,12 @@
 #ifndef CACHELAB_TOOLS_H
 #define CACHELAB_TOOLS_H
 
+/* Maximum array dimension */
+#define MAXN 1024
+
 #define MAX_SHIFT_FUNCS 100
+#define MAX_SCRATCH_BUFS 16
+#define MAX_TRACE_REGIONS 32
 
 typedef struct shift_funct {
   void (*func_ptr)(int M,int N,int[M][N], int s, int E, int b);
@@ -17,13 +22,75 @@ typedef struct shift_funct {
   unsigned int num_evictions;
 } shift_funct_t;
 
+/* A scratch buffer that a shift function touches besides the matrix */
+typedef struct scratch_buf {
+  void* base;
+  unsigned long long int len;
+  char* description;
+} scratch_buf_t;
+
+/* An address range [start, end) published in .marker by tracegen. Only
+   accesses that fall inside one of these regions are kept in a filtered
+   trace. */
+typedef struct trace_region {
+  unsigned long long int start;
+  unsigned long long int end;
+  char name[64];
+  unsigned long long int num_accesses;
+} trace_region_t;
+
+/* Tile parameters of the tunable shift family in shift.c */
+typedef struct shift_params {
+  int tile_w;  /* strip width in ints */
+  int tile_h;  /* rows per tile */
+  int unroll;  /* inner loop unroll factor (1, 2 or 4) */
+  int carry;   /* 1: carry each column bottom-up, ignoring the tiles */
+} shift_params_t;
+
+/* One row of the table written by the autotuner (test-shift -T) */
+typedef struct shift_tuning {
+  int M, N, s, E, b;
+  shift_params_t params;
+} shift_tuning_t;
+
+/* One specialized kernel written by shiftgen, for the dispatcher */
+typedef struct shift_generated {
+  int M, N, s, E, b;
+  void (*func_ptr)(int M,int N,int[M][N], int s, int E, int b);
+} shift_generated_t;
+
+/* An LRU set-associative cache simulated in process, used to score
+   kernel access patterns without generating a valgrind trace */
+typedef struct sim_cache {
+  int s, E, b;
+  unsigned long long int *tags;  /* S*E tags */
+  unsigned long long int *stamp; /* last use of each line, 0 if invalid */
+  unsigned long long int clock;
+  unsigned long long int hits, misses, evictions;
+} sim_cache_t;
+
 /* Prints final hit and miss statistics */
 void printSummary(int hits,  /* number of  hits */
 				  int misses, /* number of misses */
 				  int evictions); /* number of evictions */
 
-/* Fill the matrix with data */
-void initMatrix(int M, int N, int A[M][N]);
+/* Seed used when none is given on the command line */
+#define DEFAULT_SEED 2021
+
+/* Fill the matrix with data determined by seed */
+void initMatrix(int M, int N, int A[M][N], unsigned int seed);
+
+/* The value initMatrix() stores at flat index idx */
+int matrixValue(unsigned int seed, unsigned int idx);
+
+/* The value A[i][j] holds after `shifts` shifts of a seeded matrix */
+int expectedValue(int M, int N, unsigned int seed, int shifts, int i, int j);
+
+/* Position-sensitive checksum of a matrix */
+unsigned long long int matrixChecksum(int M, int N, int A[M][N]);
+
+/* Checksum of a seeded matrix after `shifts` shifts, from the seed alone */
+unsigned long long int expectedChecksum(int M, int N, unsigned int seed, int shifts);
 
 /* The baseline shift function that produces correct results. */
 void correctShift(int M, int N, int A[M][N], int s, int E, int b);
@@ -32,4 +99,16 @@ void correctShift(int M, int N, int A[M][N], int s, int E, int b);
 void registerShiftFunction(
     void (*shift)(int M,int N,int[M][N], int s, int E, int b), char* desc);
 
+/* Record a scratch buffer so its accesses are kept in the filtered trace */
+void registerScratchBuffer(void* base, unsigned long long int len, char* desc);
+
+/* Create an empty simulated cache with 2^s sets of E lines of 2^b bytes */
+void simCacheInit(sim_cache_t *c, int s, int E, int b);
+
+/* Access one address in the simulated cache, updating its counters */
+void simCacheAccess(sim_cache_t *c, unsigned long long int addr);
+
+/* Free the memory held by a simulated cache */
+void simCacheFree(sim_cache_t *c);
+
 #endif /* CACHELAB_TOOLS_H */
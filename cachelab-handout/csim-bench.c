@@ -0,0 +1,439 @@
+/*
+ * csim-bench.c - Throughput benchmark for the cache simulators.
+ *
+ * Generates reproducible synthetic traces in the valgrind format that
+ * csim reads (sequential, strided, uniform random, pointer chase, matrix
+ * tiles and a Zipfian hot set), runs ./csim and the reference simulators
+ * over each of them and reports accesses per second, peak RSS and how
+ * the time splits between parsing the trace and simulating the cache.
+ * Results are written as JSON so that runs can be compared mechanically.
+ *
+ * The parse/simulate split comes from csim itself: each trace is also
+ * run through ./csim-stats (csim built with -DCSIM_STATS), whose phase
+ * cycle counters are reported as shares of the run. The reference
+ * simulators cannot be instrumented, so no split is given for them.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* Defaults for the command line */
+#define DEFAULT_ACCESSES 2000000
+#define DEFAULT_SEED 2021
+
+/* Simulators we try to run, in order; missing or non-executable ones
+   are reported as skipped */
+static char *simulators[] = { "./csim", "./csim-ref", "./csim-MRU-ref" };
+#define NUM_SIMULATORS ((int) (sizeof(simulators) / sizeof(simulators[0])))
+
+/* Instrumented build of ./csim and the file it writes its counters to */
+#define STATS_SIMULATOR "./csim-stats"
+#define STATS_FILE ".csim-bench-stats"
+
+/* Phases csim-stats reports, in the order they are printed */
+#define NUM_PHASES 4
+static char *phase_names[NUM_PHASES] = { "init", "parse", "lookup", "victim" };
+
+/* Synthetic trace patterns */
+typedef enum {
+    PAT_SEQ, PAT_STRIDE, PAT_RANDOM, PAT_PCHASE, PAT_TILES, PAT_ZIPF, NUM_PATTERNS
+} pattern_t;
+
+static char *pattern_names[NUM_PATTERNS] = {
+    "seq", "stride", "random", "pchase", "tiles", "zipf"
+};
+
+/* Globals set by command line args */
+static long accesses = DEFAULT_ACCESSES;
+static unsigned long long int seed = DEFAULT_SEED;
+static int s = 8, E = 4, b = 6;
+static char *trace_dir = "bench-traces";
+static char *out_file = NULL;
+
+/* Base of the synthetic address space, so traces look like heap data */
+#define TRACE_BASE 0x10000000ULL
+
+/*
+ * next_rand - xorshift64* step; deterministic for a given seed.
+ */
+static unsigned long long int rng_state;
+
+static unsigned long long int next_rand()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/*
+ * emit - Write one access; every 4th is a store and every 8th a modify,
+ *     so all three operations csim handles show up.
+ */
+static void emit(FILE *fp, long i, unsigned long long int addr)
+{
+    char op = (i % 8 == 7) ? 'M' : (i % 4 == 3) ? 'S' : 'L';
+    fprintf(fp, " %c %llx,4\n", op, addr);
+}
+
+/*
+ * genTrace - Write `accesses` trace lines of the given pattern to fn.
+ */
+static void genTrace(pattern_t p, char *fn)
+{
+    FILE *fp = fopen(fn, "w");
+    long i, k, n;
+    unsigned long long int addr = 0;
+    unsigned long long int *next = NULL;
+    double *cdf = NULL;
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", fn, strerror(errno));
+        exit(1);
+    }
+    rng_state = seed * 0x9e3779b97f4a7c15ULL + p + 1;
+
+    switch (p) {
+    case PAT_PCHASE:
+        /* One random cycle through 1M 64-byte nodes (Sattolo's algorithm) */
+        n = 1 << 20;
+        next = malloc(sizeof(*next) * n);
+        assert(next);
+        for (k = 0; k < n; k++)
+            next[k] = k;
+        for (k = n - 1; k > 0; k--) {
+            long j = (long) (next_rand() % k);
+            unsigned long long int t = next[k];
+            next[k] = next[j];
+            next[j] = t;
+        }
+        break;
+    case PAT_ZIPF:
+        /* Zipf(1.0) over 64K blocks via a cumulative distribution */
+        n = 1 << 16;
+        cdf = malloc(sizeof(*cdf) * n);
+        assert(cdf);
+        for (k = 0; k < n; k++)
+            cdf[k] = (k ? cdf[k-1] : 0) + 1.0 / (k + 1);
+        for (k = 0; k < n; k++)
+            cdf[k] /= cdf[n-1];
+        break;
+    default:
+        n = 0;
+        break;
+    }
+
+    for (i = 0, k = 0; i < accesses; i++) {
+        switch (p) {
+        case PAT_SEQ:
+            addr = TRACE_BASE + 4ULL * i;
+            break;
+        case PAT_STRIDE:
+            /* 4 KiB stride wrapping around a 64 MiB region */
+            addr = TRACE_BASE + ((4096ULL * i) % (64ULL << 20)) + 4 * ((4096ULL * i) / (64ULL << 20) % 1024);
+            break;
+        case PAT_RANDOM:
+            addr = TRACE_BASE + (next_rand() % (64ULL << 20)) / 4 * 4;
+            break;
+        case PAT_PCHASE:
+            k = (long) next[k];
+            addr = TRACE_BASE + 64ULL * k;
+            break;
+        case PAT_TILES: {
+            /* 32x32 tiles of a 1024x1024 int matrix, row-major in a tile */
+            long t = i / 1024, e = i % 1024;
+            long ti = (t / 32) % 32, tj = t % 32;
+            addr = TRACE_BASE + 4ULL * ((ti * 32 + e / 32) * 1024 + tj * 32 + e % 32);
+            break;
+        }
+        case PAT_ZIPF: {
+            double u = (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+            long lo = 0, hi = n - 1;
+            while (lo < hi) {
+                long mid = (lo + hi) / 2;
+                if (cdf[mid] < u)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            /* Scatter the ranks so hot blocks do not share sets */
+            addr = TRACE_BASE + 64ULL * ((lo * 2654435761ULL) % (1ULL << 20));
+            break;
+        }
+        default:
+            break;
+        }
+        emit(fp, i, addr);
+    }
+
+    free(next);
+    free(cdf);
+    fclose(fp);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * countAccesses - Count the cache accesses csim makes for fn: one per L
+ *     or S line and two per M line.
+ */
+static long countAccesses(char *fn)
+{
+    char buf[1000];
+    long count = 0;
+    FILE *fp = fopen(fn, "r");
+    assert(fp);
+
+    while (fgets(buf, 1000, fp) != NULL) {
+        if (buf[1] == 'S' || buf[1] == 'L')
+            count++;
+        else if (buf[1] == 'M')
+            count += 2;
+    }
+    fclose(fp);
+    return count;
+}
+
+/* Result of running one simulator on one trace */
+typedef struct run_result {
+    int ran;
+    double wall_sec, user_sec, sys_sec;
+    long max_rss_kb;
+    int hits, misses, evictions;
+} run_result_t;
+
+/*
+ * runSimulator - Run sim on fn with stdout discarded, collecting its
+ *     wall time, CPU time, peak RSS and the counts it left in
+ *     .csim_results.
+ */
+static void runSimulator(char *sim, char *fn, run_result_t *r, char *stats_file)
+{
+    char sarg[16], Earg[16], barg[16];
+    struct rusage ru;
+    int status, fd;
+    double start;
+    pid_t pid;
+    FILE *fp;
+
+    memset(r, 0, sizeof(*r));
+    if (access(sim, X_OK) != 0)
+        return;
+
+    sprintf(sarg, "%d", s);
+    sprintf(Earg, "%d", E);
+    sprintf(barg, "%d", b);
+    unlink(".csim_results");
+
+    start = now_sec();
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        fd = open("/dev/null", O_WRONLY);
+        dup2(fd, 1);
+        if (stats_file)
+            execl(sim, sim, "-s", sarg, "-E", Earg, "-b", barg, "-t", fn,
+                  "-o", stats_file, (char *) NULL);
+        else
+            execl(sim, sim, "-s", sarg, "-E", Earg, "-b", barg, "-t", fn, (char *) NULL);
+        _exit(127);
+    }
+    wait4(pid, &status, 0, &ru);
+    r->wall_sec = now_sec() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return;
+
+    r->ran = 1;
+    r->user_sec = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6;
+    r->sys_sec = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+    r->max_rss_kb = ru.ru_maxrss;
+    fp = fopen(".csim_results", "r");
+    if (fp) {
+        if (fscanf(fp, "%d %d %d", &r->hits, &r->misses, &r->evictions) != 3)
+            r->hits = r->misses = r->evictions = -1;
+        fclose(fp);
+    }
+}
+
+/*
+ * readSplit - Read the per-phase cycle counts csim-stats wrote to fn into
+ *     cycles[]. Returns 0 if the file is missing or incomplete.
+ */
+static int readSplit(char *fn, unsigned long long int cycles[NUM_PHASES])
+{
+    char line[256], name[16];
+    unsigned long long int n;
+    int i, found = 0;
+    FILE *fp = fopen(fn, "r");
+
+    if (!fp)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "phase %15s cycles=%llu", name, &n) != 2)
+            continue;
+        for (i = 0; i < NUM_PHASES; i++) {
+            if (strcmp(name, phase_names[i]) == 0) {
+                cycles[i] = n;
+                found++;
+            }
+        }
+    }
+    fclose(fp);
+    return found == NUM_PHASES;
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-n <num>] [-S <seed>] [-s <num>] [-E <num>] [-b <num>] [-d <dir>] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -n <num>   Lines per synthetic trace (default %d)\n", DEFAULT_ACCESSES);
+    printf("  -S <seed>  Seed for the synthetic traces (default %d)\n", DEFAULT_SEED);
+    printf("  -s <num>   Number of set index bits (default 8)\n");
+    printf("  -E <num>   Number of lines per set (default 4)\n");
+    printf("  -b <num>   Number of block offset bits (default 6)\n");
+    printf("  -d <dir>   Directory for the generated traces (default bench-traces)\n");
+    printf("  -o <file>  Write the JSON results to file instead of stdout\n");
+    printf("\nExample:\n");
+    printf("  linux>  %s -n 1000000 -o bench.json\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char c;
+    char fn[512];
+    int p, k;
+    long count;
+    unsigned long long int cycles[NUM_PHASES], total;
+    int have_split;
+    run_result_t r;
+    FILE *out = stdout;
+
+    while ((c = getopt(argc, argv, "n:S:s:E:b:d:o:h")) != -1) {
+        switch (c) {
+        case 'n':
+            accesses = atol(optarg);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'd':
+            trace_dir = optarg;
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (accesses <= 0 || s <= 0 || E <= 0 || b <= 0) {
+        printf("%s: Counts and cache parameters must be positive\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+
+    if (mkdir(trace_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", trace_dir, strerror(errno));
+        exit(1);
+    }
+    if (out_file) {
+        out = fopen(out_file, "w");
+        if (!out) {
+            fprintf(stderr, "%s: %s\n", out_file, strerror(errno));
+            exit(1);
+        }
+    }
+
+    fprintf(out, "{\n  \"config\": { \"s\": %d, \"E\": %d, \"b\": %d, "
+            "\"trace_lines\": %ld, \"seed\": %llu },\n  \"results\": [\n",
+            s, E, b, accesses, seed);
+
+    for (p = 0; p < NUM_PATTERNS; p++) {
+        snprintf(fn, sizeof(fn), "%s/%s.trace", trace_dir, pattern_names[p]);
+        fprintf(stderr, "Generating %s\n", fn);
+        genTrace(p, fn);
+        count = countAccesses(fn);
+
+        /* The split is taken once per trace from the instrumented csim;
+           its cycle counters slow it down, so it is not timed */
+        fprintf(stderr, "Running %s on %s\n", STATS_SIMULATOR, fn);
+        unlink(STATS_FILE);
+        runSimulator(STATS_SIMULATOR, fn, &r, STATS_FILE);
+        have_split = r.ran && readSplit(STATS_FILE, cycles);
+        unlink(STATS_FILE);
+
+        fprintf(out, "    { \"trace\": \"%s\", \"accesses\": %ld,\n"
+                "      \"simulators\": [\n", pattern_names[p], count);
+        for (k = 0; k < NUM_SIMULATORS; k++) {
+            fprintf(stderr, "Running %s on %s\n", simulators[k], fn);
+            runSimulator(simulators[k], fn, &r, NULL);
+            fprintf(out, "        { \"name\": \"%s\", ", simulators[k]);
+            if (!r.ran) {
+                fprintf(out, "\"skipped\": true }");
+                fprintf(out, "%s\n", k + 1 < NUM_SIMULATORS ? "," : "");
+                continue;
+            }
+            fprintf(out, "\"wall_sec\": %.6f, \"user_sec\": %.6f, \"sys_sec\": %.6f, "
+                    "\"accesses_per_sec\": %.0f, \"max_rss_kb\": %ld, "
+                    "\"hits\": %d, \"misses\": %d, \"evictions\": %d, ",
+                    r.wall_sec, r.user_sec, r.sys_sec, count / r.wall_sec,
+                    r.max_rss_kb, r.hits, r.misses, r.evictions);
+
+            /* Only ./csim has an instrumented build to measure the split */
+            if (k == 0 && have_split) {
+                total = cycles[0] + cycles[1] + cycles[2] + cycles[3];
+                fprintf(out, "\"split\": { \"source\": \"%s\", "
+                        "\"init_share\": %.4f, \"parse_share\": %.4f, "
+                        "\"simulate_share\": %.4f } }",
+                        STATS_SIMULATOR, (double) cycles[0] / total,
+                        (double) cycles[1] / total,
+                        (double) (cycles[2] + cycles[3]) / total);
+            } else {
+                fprintf(out, "\"split\": null }");
+            }
+            fprintf(out, "%s\n", k + 1 < NUM_SIMULATORS ? "," : "");
+        }
+        fprintf(out, "      ] }%s\n", p + 1 < NUM_PATTERNS ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -22,6 +22,63 @@
 //#define DEBUG_ON
 #define ADDRESS_LENGTH 64
 
+/*
+ * Instrumentation. Build with -DCSIM_STATS (make csim-stats) to count
+ * cycles per phase (trace parsing, set lookup, victim selection and
+ * cache setup) and the ways probed per access, and to report hit, miss
+ * and eviction rates for every window (see -w below; 100000 accesses
+ * unless given) on stderr or the -o file. In the normal build the STAT_
+ * macros expand to nothing.
+ */
+//#define CSIM_STATS
+#ifdef CSIM_STATS
+#include <x86intrin.h>
+
+#define STAT_DEFAULT_INTERVAL 100000
+
+typedef enum {
+    PHASE_INIT, PHASE_PARSE, PHASE_LOOKUP, PHASE_VICTIM, NUM_PHASES
+} stat_phase_t;
+
+static char *stat_phase_names[NUM_PHASES] = {
+    "init", "parse", "lookup", "victim"
+};
+
+unsigned long long int stat_cycles[NUM_PHASES];
+unsigned long long int stat_probes = 0;
+unsigned long long int stat_win_probes = 0;  /* stat_probes at window start */
+char* stat_file = NULL;
+FILE* stat_fp = NULL;
+
+void statWindow(unsigned long long int start, unsigned long long int n,
+                double miss_rate, int evictions);
+
+/*
+ * statLap - Charge the cycles since *t to phase and restart *t.
+ */
+static inline void statLap(stat_phase_t phase, unsigned long long int *t)
+{
+    unsigned long long int now = __rdtsc();
+    stat_cycles[phase] += now - *t;
+    *t = now;
+}
+
+#define STAT_OPTS "o:"
+#define STAT_VAR(t) unsigned long long int t = __rdtsc()
+#define STAT_MARK(t) ((t) = __rdtsc())
+#define STAT_LAP(phase, t) statLap(phase, &(t))
+#define STAT_PROBES(n) (stat_probes += (n))
+#define STAT_WINDOW(start, n, miss_rate, evictions) \
+    statWindow(start, n, miss_rate, evictions)
+#else
+#define STAT_OPTS ""
+#define STAT_VAR(t)
+#define STAT_MARK(t)
+#define STAT_LAP(phase, t)
+#define STAT_PROBES(n)
+#define STAT_WINDOW(start, n, miss_rate, evictions)
+#endif
+
 /* Type: Memory address */
 typedef unsigned long long int mem_addr_t;
 
@@ -53,6 +110,57 @@ int hit_count = 0;
 int eviction_count = 0;
 unsigned long long int mru_counter = 1;
 
+/*
+ * Windowed statistics. The accesses are cut into windows of window_size;
+ * endWindow() closes each one and hands its counts to the timeline and,
+ * in the instrumented build, to statWindow().
+ *
+ * With -w the timeline prints the miss rate, the evictions and the number
+ * of distinct blocks touched in each window. Distinct blocks are estimated
+ * with a HyperLogLog sketch of 2^WS_BITS one-byte registers (about 3%
+ * error) so the cost per access is one hash. A window whose miss rate or
+ * working set departs from the running average of the current phase
+ * starts a new phase.
+ */
+#define WS_BITS 10
+#define WS_REGS (1 << WS_BITS)
+#define PHASE_MISS_DELTA 0.10   /* absolute change in miss rate */
+#define PHASE_WS_RATIO 2.0      /* relative change in working set */
+
+long window_size = 0;
+int timeline = 0;       /* print the -w timeline */
+unsigned long long int win_start = 0, win_accesses = 0;
+int win_misses, win_evictions;
+unsigned char ws_regs[WS_REGS];
+
+/* The phase the current window is being compared against */
+int phase_id = 0;
+unsigned long long int phase_start = 0;
+int phase_windows = 0;
+double phase_miss_sum = 0, phase_ws_sum = 0;
+
+/*
+ * TLB model (-p). Every access is translated through an L1 and an L2 TLB
+ * before the cache lookup; both are set associative with LRU replacement
+ * and an L2 hit refills the L1. A miss in both costs a page walk of one
+ * access per page table level: 4 for 4KiB pages and 3 for 2MiB pages.
+ * Translation is the identity, so the cache still sees the trace address.
+ */
+typedef struct tlb {
+    char *name;
+    int entries, ways, sets;
+    mem_addr_t *vpn;
+    unsigned long long int *lru;   /* 0 marks an empty entry */
+    int hits, misses;
+} tlb_t;
+
+int page_bits = 0;      /* 12 or 21; 0 disables the TLB model */
+tlb_t tlb_l1 = { "l1", 64, 4 };
+tlb_t tlb_l2 = { "l2", 1536, 12 };
+unsigned long long int tlb_counter = 0;
+int page_walks = 0;
+long long int walk_accesses = 0;
+
 /* The cache we are simulating */
 cache_t cache;
 mem_addr_t set_index_mask;
@@ -91,6 +199,215 @@ void freeCache()
     free(cache);
 }
 
+/*
+ * initTlb - Check the geometry of tlb and allocate its entries.
+ */
+void initTlb(tlb_t *tlb)
+{
+    if (tlb->entries < 1 || tlb->ways < 1 || tlb->entries % tlb->ways) {
+        printf("TLB %s: %d entries cannot be split into %d ways\n",
+               tlb->name, tlb->entries, tlb->ways);
+        exit(1);
+    }
+    tlb->sets = tlb->entries / tlb->ways;
+    tlb->vpn = calloc(tlb->entries, sizeof(mem_addr_t));
+    tlb->lru = calloc(tlb->entries, sizeof(unsigned long long int));
+    assert(tlb->vpn && tlb->lru);
+}
+
+/*
+ * tlbLookup - Look up vpn in tlb, counting a hit or a miss. On a miss vpn
+ *             replaces the least recently used entry of its set.
+ */
+int tlbLookup(tlb_t *tlb, mem_addr_t vpn)
+{
+    int base = (vpn % tlb->sets) * tlb->ways;
+    int i, victim = base;
+
+    for (i = base; i < base + tlb->ways; i++) {
+        if (tlb->lru[i] && tlb->vpn[i] == vpn) {
+            tlb->lru[i] = tlb_counter;
+            tlb->hits++;
+            return 1;
+        }
+        if (tlb->lru[i] < tlb->lru[victim])
+            victim = i;
+    }
+    tlb->vpn[victim] = vpn;
+    tlb->lru[victim] = tlb_counter;
+    tlb->misses++;
+    return 0;
+}
+
+/*
+ * translate - Run addr through the TLBs, walking the page table when
+ *             neither holds its page.
+ */
+void translate(mem_addr_t addr)
+{
+    mem_addr_t vpn = addr >> page_bits;
+
+    tlb_counter++;
+    if (tlbLookup(&tlb_l1, vpn))
+        return;
+    if (tlbLookup(&tlb_l2, vpn))
+        return;
+    page_walks++;
+    walk_accesses += page_bits == 12 ? 4 : 3;
+}
+
+/*
+ * parseTlb - Parse "<entries>,<ways>" into tlb.
+ */
+void parseTlb(tlb_t *tlb, char *arg, char* argv[])
+{
+    if (sscanf(arg, "%d,%d", &tlb->entries, &tlb->ways) != 2) {
+        printf("%s: Cannot parse TLB geometry \"%s\"\n", argv[0], arg);
+        exit(1);
+    }
+}
+
+/*
+ * wsAdd - Add the block holding addr to the working set sketch.
+ */
+static inline void wsAdd(mem_addr_t addr)
+{
+    unsigned long long int h = addr >> b;
+    int rank;
+
+    /* splitmix64 finalizer, so nearby blocks spread over all registers */
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+
+    rank = (h << WS_BITS) ? __builtin_clzll(h << WS_BITS) + 1 : 64 - WS_BITS + 1;
+    if (rank > ws_regs[h >> (64 - WS_BITS)])
+        ws_regs[h >> (64 - WS_BITS)] = rank;
+}
+
+/*
+ * wsEstimate - Estimate the distinct blocks added since the last reset,
+ *              using linear counting while many registers are still empty.
+ */
+double wsEstimate()
+{
+    double sum = 0, est;
+    int i, zeros = 0;
+
+    for (i = 0; i < WS_REGS; i++) {
+        sum += 1.0 / (1ULL << ws_regs[i]);
+        zeros += ws_regs[i] == 0;
+    }
+    est = (0.7213 / (1 + 1.079 / WS_REGS)) * WS_REGS * WS_REGS / sum;
+    if (est <= 2.5 * WS_REGS && zeros)
+        est = WS_REGS * log((double) WS_REGS / zeros);
+    return est;
+}
+
+/*
+ * printPhase - Print the totals of the phase that ends at access `end`.
+ */
+void printPhase(unsigned long long int end)
+{
+    printf("phase %d: accesses %llu-%llu windows=%d miss_rate=%.4f blocks=%.0f\n",
+           phase_id, phase_start, end, phase_windows,
+           phase_miss_sum / phase_windows, phase_ws_sum / phase_windows);
+}
+
+/*
+ * timelineWindow - Print one window of the -w timeline and decide whether
+ *                  it starts a new phase.
+ */
+void timelineWindow(double miss_rate, int evictions)
+{
+    unsigned long long int end = win_start + win_accesses;
+    double blocks = wsEstimate(), mean_miss, mean_ws;
+
+    /* A partial last window always belongs to the current phase */
+    if (phase_windows > 0 && win_accesses == window_size) {
+        mean_miss = phase_miss_sum / phase_windows;
+        mean_ws = phase_ws_sum / phase_windows;
+        if (fabs(miss_rate - mean_miss) > PHASE_MISS_DELTA ||
+            blocks > PHASE_WS_RATIO * mean_ws || blocks * PHASE_WS_RATIO < mean_ws) {
+            printPhase(win_start);
+            phase_id++;
+            phase_start = win_start;
+            phase_windows = 0;
+            phase_miss_sum = phase_ws_sum = 0;
+        }
+    }
+    phase_windows++;
+    phase_miss_sum += miss_rate;
+    phase_ws_sum += blocks;
+
+    printf("window %llu-%llu: miss_rate=%.4f evictions=%d blocks=%.0f phase=%d\n",
+           win_start, end, miss_rate, evictions, blocks, phase_id);
+    memset(ws_regs, 0, sizeof(ws_regs));
+}
+
+/*
+ * endWindow - Close the current window, report it and start the next one.
+ */
+void endWindow()
+{
+    double miss_rate;
+    int evictions;
+
+    if (win_accesses == 0)
+        return;
+    miss_rate = (double) (miss_count - win_misses) / win_accesses;
+    evictions = eviction_count - win_evictions;
+
+    if (timeline)
+        timelineWindow(miss_rate, evictions);
+    STAT_WINDOW(win_start, win_accesses, miss_rate, evictions);
+
+    win_start += win_accesses;
+    win_accesses = 0;
+    win_misses = miss_count;
+    win_evictions = eviction_count;
+}
+
+#ifdef CSIM_STATS
+/*
+ * statWindow - Report the rates and ways probed over the window of n
+ *              accesses starting at start.
+ */
+void statWindow(unsigned long long int start, unsigned long long int n,
+                double miss_rate, int evictions)
+{
+    fprintf(stat_fp, "window %llu-%llu: hit_rate=%.4f miss_rate=%.4f "
+            "eviction_rate=%.4f ways_probed=%.2f\n",
+            start, start + n, 1 - miss_rate, miss_rate,
+            (double) evictions / n, (double) (stat_probes - stat_win_probes) / n);
+    stat_win_probes = stat_probes;
+}
+
+/*
+ * statReport - Print the cycles spent in each phase and the average ways
+ *              probed per access.
+ */
+void statReport()
+{
+    int i;
+    unsigned long long int total = 0;
+    unsigned long long int stat_accesses = hit_count + miss_count;
+
+    for (i = 0; i < NUM_PHASES; i++)
+        total += stat_cycles[i];
+    fprintf(stat_fp, "accesses=%llu ways_probed=%.2f\n", stat_accesses,
+            stat_accesses ? (double) stat_probes / stat_accesses : 0.0);
+    for (i = 0; i < NUM_PHASES; i++) {
+        fprintf(stat_fp, "phase %-6s cycles=%llu (%.1f%%) cycles/access=%.1f\n",
+                stat_phase_names[i], stat_cycles[i],
+                total ? 100.0 * stat_cycles[i] / total : 0.0,
+                stat_accesses ? (double) stat_cycles[i] / stat_accesses : 0.0);
+    }
+    if (stat_fp != stderr)
+        fclose(stat_fp);
+}
+#endif
+
 /*
  * accessData - Access data at memory address addr. If it is already in the
  *              cache, increment hit_count. If it is not in the cache, bring it
@@ -100,14 +417,27 @@ void freeCache()
  void accessData(mem_addr_t addr){
    int set_bit = (addr >> b) & set_index_mask;
    int tag_bit = addr >> (b+s);
-   int mru_bit = cache[set_bit][0].mru;
-   int m = 0;
+   int mru_bit;
+   int i, m = 0;
+   if (page_bits)
+     translate(addr);
    mru_counter++;
+   if (window_size) {
+     if (win_accesses == window_size)
+       endWindow();
+     win_accesses++;
+     if (timeline)
+       wsAdd(addr);
+   }
+   STAT_VAR(t);
 
-   for (int i = 0; i < E; i++) {
+   /* Look for the block, or for an empty line to bring it into */
+   for (i = 0; i < E; i++) {
      if (cache[set_bit][i].valid && cache[set_bit][i].tag == tag_bit) {
        cache[set_bit][i].mru = mru_counter;
        hit_count++;
+       STAT_PROBES(i + 1);
+       STAT_LAP(PHASE_LOOKUP, t);
        return;
      }
      if (!cache[set_bit][i].valid) {
@@ -115,8 +445,17 @@ void freeCache()
        cache[set_bit][i].mru = mru_counter;
        cache[set_bit][i].valid = 1;
        miss_count++;
+       STAT_PROBES(i + 1);
+       STAT_LAP(PHASE_LOOKUP, t);
        return;
      }
+   }
+   STAT_PROBES(E);
+   STAT_LAP(PHASE_LOOKUP, t);
+
+   /* The set is full: evict the most recently used line */
+   mru_bit = cache[set_bit][0].mru;
+   for (i = 0; i < E; i++) {
      if(cache[set_bit][i].mru > mru_bit) {
        mru_bit = cache[set_bit][i].mru;
        m = i;
@@ -127,6 +466,7 @@ void freeCache()
    cache[set_bit][m].mru = mru_counter;
    miss_count++;
    eviction_count++;
+   STAT_LAP(PHASE_VICTIM, t);
  }
 
 /*
@@ -145,6 +485,7 @@ void replayTrace(char* trace_fn)
         exit(1);
     }
 
+    STAT_VAR(t);
     while( fgets(buf, 1000, trace_fp) != NULL )
     {
         /* buf[Y] gives the Yth byte in the trace line */
@@ -160,14 +501,17 @@ void replayTrace(char* trace_fn)
          */
          if (buf[1] == 'S' || buf[1] == 'L' || buf[1] == 'M'){
            sscanf(buf+3, "%llx,%u", &addr, &len);
+           STAT_LAP(PHASE_PARSE, t);
            accessData(addr);
            if (buf[1] == 'M'){
              accessData(addr);
          }
+           STAT_MARK(t);
          }
 
 
 }
+    STAT_LAP(PHASE_PARSE, t);
     fclose(trace_fp);
 }
 
@@ -177,7 +521,7 @@ void replayTrace(char* trace_fn)
  */
 void printUsage(char* argv[])
 {
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file> [-w <num>] [-p <size>]\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
@@ -185,6 +529,15 @@ void printUsage(char* argv[])
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
     printf("  -t <file>  Trace file.\n");
+    printf("  -w <num>   Print miss rate, evictions and working set every <num> accesses.\n");
+    printf("  -p <size>  Model the TLBs with 4k or 2m pages.\n");
+    printf("  -l <n>,<w> L1 TLB entries and ways (default %d,%d).\n",
+           tlb_l1.entries, tlb_l1.ways);
+    printf("  -L <n>,<w> L2 TLB entries and ways (default %d,%d).\n",
+           tlb_l2.entries, tlb_l2.ways);
+#ifdef CSIM_STATS
+    printf("  -o <file>  Write statistics to file instead of stderr.\n");
+#endif
     printf("\nExamples:\n");
     printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
@@ -198,7 +551,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while( (c=getopt(argc,argv,"s:E:b:t:vh")) != -1 )
+    while( (c=getopt(argc,argv,"s:E:b:t:w:p:l:L:vh" STAT_OPTS)) != -1 )
     {
         switch (c)
         {
@@ -214,9 +567,34 @@ int main(int argc, char* argv[])
             case 't':
                 trace_file = optarg;
                 break;
+            case 'w':
+                window_size = atol(optarg);
+                timeline = 1;
+                break;
+            case 'p':
+                if (strcmp(optarg, "4k") == 0)
+                    page_bits = 12;
+                else if (strcmp(optarg, "2m") == 0)
+                    page_bits = 21;
+                else {
+                    printf("%s: Page size must be 4k or 2m\n", argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'l':
+                parseTlb(&tlb_l1, optarg, argv);
+                break;
+            case 'L':
+                parseTlb(&tlb_l2, optarg, argv);
+                break;
             case 'v':
                 verbosity = 1;
                 break;
+#ifdef CSIM_STATS
+            case 'o':
+                stat_file = optarg;
+                break;
+#endif
             case 'h':
                 printUsage(argv);
                 exit(0);
@@ -234,13 +612,37 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    if (timeline && window_size <= 0)
+    {
+        printf("%s: Window size must be positive\n", argv[0]);
+        exit(1);
+    }
+
     /* Compute S, E, and B from command line args */
     //S =  ?
     //B =  ?
     S = pow(2, s);
     B = pow(2, b);
+#ifdef CSIM_STATS
+    if (!window_size)
+        window_size = STAT_DEFAULT_INTERVAL;
+    stat_fp = stderr;
+    if (stat_file && !(stat_fp = fopen(stat_file, "w")))
+    {
+        fprintf(stderr, "%s: %s\n", stat_file, strerror(errno));
+        exit(1);
+    }
+#endif
+
+    if (page_bits) {
+        initTlb(&tlb_l1);
+        initTlb(&tlb_l2);
+    }
+
     /* Initialize cache */
+    STAT_VAR(t);
     initCache();
+    STAT_LAP(PHASE_INIT, t);
 
 #ifdef DEBUG_ON
     printf("DEBUG: S:%u E:%u B:%u trace:%s\n", S, E, B, trace_file);
@@ -250,10 +652,26 @@ int main(int argc, char* argv[])
 	/* Read the trace and access the cache */
     replayTrace(trace_file);
 
+    /* Flush the last, possibly partial, window and close its phase */
+    if (window_size) {
+        endWindow();
+        if (timeline && phase_windows > 0)
+            printPhase(win_start);
+    }
+
     /* Free allocated memory */
     freeCache();
 
+#ifdef CSIM_STATS
+    statReport();
+#endif
+
     /* Output the hit and miss statistics for the autograder */
     printSummary(hit_count, miss_count, eviction_count);
+    if (page_bits) {
+        printf("tlb %s: hits:%d misses:%d\n", tlb_l1.name, tlb_l1.hits, tlb_l1.misses);
+        printf("tlb %s: hits:%d misses:%d\n", tlb_l2.name, tlb_l2.hits, tlb_l2.misses);
+        printf("page walks:%d walk accesses:%lld\n", page_walks, walk_accesses);
+    }
     return 0;
 }
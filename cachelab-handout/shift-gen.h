@@ -0,0 +1,42 @@
+/*
+ * File:        shift-gen.h
+ * Description: Straight-line shift kernels for fixed (M, N, s, E, b),
+ *              written by ./shiftgen. Regenerate instead of editing.
+ */
+void matrix_shift_submit(int M, int N, int A[M][N], int s, int E, int b);
+
+/* 4x4, s=1 E=2 b=3: strip width 4, lower row written last, 8 misses simulated */
+static char shift_gen_4x4_s1_E2_b3_desc[] = "Generated shift 4x4 s=1 E=2 b=3";
+static void shift_gen_4x4_s1_E2_b3(int M, int N, int A[M][N], int s, int E, int b)
+{
+    register int *a = &A[0][0];
+    register int u, v;
+
+    if (M != 4 || N != 4) {
+        matrix_shift_submit(M, N, A, s, E, b);
+        return;
+    }
+    u = a[0]; v = a[4]; a[0] = v; a[4] = u;
+    u = a[1]; v = a[5]; a[1] = v; a[5] = u;
+    u = a[2]; v = a[6]; a[2] = v; a[6] = u;
+    u = a[3]; v = a[7]; a[3] = v; a[7] = u;
+    u = a[4]; v = a[8]; a[4] = v; a[8] = u;
+    u = a[5]; v = a[9]; a[5] = v; a[9] = u;
+    u = a[6]; v = a[10]; a[6] = v; a[10] = u;
+    u = a[7]; v = a[11]; a[7] = v; a[11] = u;
+    u = a[8]; v = a[12]; a[8] = v; a[12] = u;
+    u = a[9]; v = a[13]; a[9] = v; a[13] = u;
+    u = a[10]; v = a[14]; a[10] = v; a[14] = u;
+    u = a[11]; v = a[15]; a[11] = v; a[15] = u;
+}
+
+static const shift_generated_t shift_generated_table[] = {
+    { 4, 4, 1, 2, 3, shift_gen_4x4_s1_E2_b3 },
+    { 0 }
+};
+
+/* Called from registerFunctions() */
+static void registerGeneratedShifts()
+{
+    registerShiftFunction(shift_gen_4x4_s1_E2_b3, shift_gen_4x4_s1_E2_b3_desc);
+}
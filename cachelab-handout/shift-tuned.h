@@ -0,0 +1,16 @@
+/*
+ * File:        shift-tuned.h
+ * Description: Tile parameters for matrix_shift_tuned(), one row per
+ *              (M, N, s, E, b). Written by ./test-shift -T; rerun the
+ *              tuner rather than editing rows by hand.
+ */
+static const shift_tuning_t shift_tuning_table[] = {
+    { 128, 128, 5, 2, 3, { 64, 128, 4, 0 } }, /* misses 8192 */
+    { 4, 4, 1, 2, 3, { 4, 4, 4, 0 } }, /* misses 8 */
+    { 128, 128, 8, 2, 3, { 128, 128, 4, 0 } }, /* misses 8192 */
+    { 256, 256, 5, 2, 3, { 64, 256, 4, 0 } }, /* misses 32768 */
+    { 256, 256, 8, 2, 3, { 256, 256, 4, 0 } }, /* misses 32768 */
+    { 1024, 1024, 8, 2, 3, { 512, 1024, 4, 0 } }, /* misses 524288 */
+    { 64, 64, 5, 1, 3, { 2, 64, 1, 1 } }, /* misses 4128 */
+    { 0 }
+};
@@ -5,8 +5,19 @@
  * void matrix_shift(int M, int N, int A[M][N], int s, int E, int b);
  *
  */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "cachelab.h"
+#include "shift-tuned.h"
+#include "shift-gen.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHIFT_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
 
 /*
  * matrix_shift_submit - This is the solution matrix shift function that you
@@ -18,24 +29,95 @@
 char matrix_shift_submit_desc[] = "Matrix shift submission";
 void matrix_shift_submit(int M, int N, int A[M][N], int s, int E, int b)
 {
-    // TODO: Fill this in
-    if (M == 4 && N == 4) {
-      int i,j,k,t0,t1;
-  for (i=1; i<M; i++) {
-      for (j=0; j<N; j+=2) {
-          for (k=0; k<2; k++) {
-              t0 = A[i][j+k];
-              t1 = A[i][j+1+k];
-
-              A[i][j+k] = A[i-1][j+k];
-              A[i][j+k+1] = A[i][j+k+1];
-              A[i-1][j+k] = t0;
-              A[i][j+k+1] = t1;
-
-          }
-      }
+    /* Loop state is kept in registers so that the only memory traffic
+       inside the loops is to A itself. */
+    register int *row, *stop, *prev, *cur, *end;
+    register int u, v, n = N, w;
+    int *base = &A[0][0];
+    int B = 1 << b;                 /* block size in bytes */
+    int bw = B / (int) sizeof(int); /* ints per cache block */
+    long row_bytes = (long) N * sizeof(int);
+    long cache_bytes = (long) B * E << s;
+    long d, k, g;
+    int j, width, lead;
+
+    if (bw < 1)
+        bw = 1;
+
+    /* Offset of A from the start of its first block */
+    lead = (int) (((unsigned long) base & (B - 1)) / sizeof(int));
+
+    /* Split the columns into vertical strips and swap each strip down
+       the rows. Only the strip segments of rows i-1 and i are live at
+       once, which is two lines per set when the segment spans at most
+       one line per set. When rows are block aligned a strip is a single
+       block wide. Otherwise a strip is a whole row when two rows fit in
+       the cache, which is the naive row order, so that no block straddles
+       two strips; only when rows are too long is it cut to a fraction of
+       the cache. */
+    if (row_bytes % B == 0 && lead == 0)
+        width = bw;
+    else if (2 * row_bytes <= cache_bytes)
+        width = N;
+    else
+        width = (int) (cache_bytes / (4 * (long) sizeof(int)));
+    if (width < bw)
+        width = bw;
+
+    if (E == 1) {
+        /* Direct-mapped: rows i-1 and i are d bytes apart in the cache. */
+        d = row_bytes % cache_bytes;
+
+        /* A column of M blocks stays resident when every row starts on a
+           block boundary and the rows fall in distinct sets, that is M is
+           at most S / gcd(row_bytes / B, S). Then, and when even adjacent
+           elements of rows i-1 and i share a set, walk each column
+           bottom-up carrying the value that belongs in the current row;
+           every element is read and written back with nothing in
+           between. */
+        k = row_bytes / B;
+        for (g = 1; g < (1L << s) && !(k & g); g <<= 1)
+            ;
+        if ((row_bytes % B == 0 && lead == 0 && M <= (1L << s) / g) ||
+            d < B || cache_bytes - d < B) {
+            for (j = 0; j < N; j++) {
+                stop = base + j;
+                u = *stop;
+                for (cur = stop + (M-1)*N; cur >= stop; cur -= n) {
+                    v = *cur;
+                    *cur = u;
+                    u = v;
+                }
+            }
+            return;
+        }
+
+        /* Strip segments of rows i-1 and i must not overlap in the cache,
+           or they evict each other; fall back to row order if they do */
+        if (d < width * (long) sizeof(int) || cache_bytes - d < width * (long) sizeof(int))
+            width = N;
+    }
+
+    /* Make the first strip end on a block boundary of row 0, unless a
+       strip is a whole row */
+    w = lead && width < N ? bw - lead : width;
+
+    for (j = 0; j < N; j += w, w = width) {
+        if (w > N - j)
+            w = N - j;
+        stop = base + (M-1)*N + j;
+        for (row = base + j; row < stop; row += n) {
+            /* Write the lower row last so it stays resident for the
+               next step, where it becomes the upper row */
+            for (prev = row, cur = row + n, end = cur + w; cur < end;
+                 prev++, cur++) {
+                u = *prev;
+                v = *cur;
+                *prev = v;
+                *cur = u;
+            }
+        }
     }
-  }
 }
 
 
@@ -62,6 +144,516 @@ void matrix_shift_function1(int M, int N, int A[M][N], int s, int E, int b)
     }
 }
 
+/* Holds the row that is displaced at the start of a rotation cycle */
+static int rotate_row_buf[MAXN];
+
+/*
+ * rotateRows - Rotate the rows of A up by k, so that row i receives the
+ *     old row (i + k) % M. The rows form gcd(M, k) independent cycles;
+ *     each cycle saves its first row once, moves every other row in the
+ *     cycle exactly once, then writes the saved row into the last slot.
+ *     When there is a single cycle with k == 1 the moves are adjacent
+ *     and are done as one block move.
+ */
+static void rotateRows(int M, int N, int A[M][N], int k)
+{
+    int c, i, next, cycles, a, t;
+    size_t row_bytes = (size_t) N * sizeof(int);
+
+    k %= M;
+    if (k == 0)
+        return;
+
+    if (k == 1) {
+        memcpy(rotate_row_buf, A[0], row_bytes);
+        memmove(A[0], A[1], (M - 1) * row_bytes);
+        memcpy(A[M-1], rotate_row_buf, row_bytes);
+        return;
+    }
+
+    /* Number of cycles is gcd(M, k) */
+    for (a = M, cycles = k; cycles != 0; ) {
+        t = a % cycles;
+        a = cycles;
+        cycles = t;
+    }
+    cycles = a;
+
+    for (c = 0; c < cycles; c++) {
+        memcpy(rotate_row_buf, A[c], row_bytes);
+        for (i = c, next = (c + k) % M; next != c; i = next, next = (next + k) % M)
+            memcpy(A[i], A[next], row_bytes);
+        memcpy(A[i], rotate_row_buf, row_bytes);
+    }
+}
+
+/*
+ * matrix_shift_rotate - Shift by rotating the rows up by one: row 0 is
+ *     saved once, the remaining rows move up in a single block move and
+ *     the saved row is written at the bottom. Each element is read and
+ *     written once instead of twice as in the swap chain.
+ */
+char matrix_shift_rotate_desc[] = "Row rotation shift";
+void matrix_shift_rotate(int M, int N, int A[M][N], int s, int E, int b)
+{
+    rotateRows(M, N, A, 1);
+}
+
+/*
+ * matrix_shift_rotate_k - Shift by rotating the rows up by k = M/2 and
+ *     then by M + 1 - k, which together move every row up by one. The
+ *     first rotation has gcd(M, k) cycles, so this exercises the general
+ *     rotate-by-k path that matrix_shift_rotate() never takes.
+ */
+char matrix_shift_rotate_k_desc[] = "Row rotation shift by k (two rotations)";
+void matrix_shift_rotate_k(int M, int N, int A[M][N], int s, int E, int b)
+{
+    int k = M / 2;
+    rotateRows(M, N, A, k);
+    rotateRows(M, N, A, M + 1 - k);
+}
+
+/*
+ * The vectorized shift is a forward copy of (M-1)*N ints from A[1] to
+ * A[0] framed by saving row 0 and writing it back at the bottom. Copying
+ * front to back is safe even though the rows overlap in a single copy,
+ * because every store lands below the next load.
+ */
+typedef void (*copy_ints_t)(int *dst, const int *src, int n);
+
+/*
+ * shift.o is built at -O0 so that the other kernels' traces show only the
+ * accesses they spell out, but at -O0 every intrinsic result round-trips
+ * through the stack. The copy routines are therefore optimized on their
+ * own. Auto-vectorization and memcpy/memmove pattern matching stay off so
+ * that each routine moves exactly the widths it names.
+ */
+#define SHIFT_COPY_OPT \
+    __attribute__((optimize("O2", "no-tree-vectorize", \
+                            "no-tree-loop-distribute-patterns")))
+
+/*
+ * copyIntsScalar - Copy n ints one at a time. This is the exact fallback
+ *     for hosts without SSE2/AVX2.
+ */
+SHIFT_COPY_OPT
+static void copyIntsScalar(int *dst, const int *src, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        dst[i] = src[i];
+}
+
+#ifdef SHIFT_HAVE_X86_SIMD
+/*
+ * copyIntsSSE2 - Copy n ints four at a time. Scalar moves bring dst to a
+ *     16-byte boundary, src is loaded unaligned, and the tail that does
+ *     not fill a vector is copied one at a time.
+ */
+SHIFT_COPY_OPT __attribute__((target("sse2")))
+static void copyIntsSSE2(int *dst, const int *src, int n)
+{
+    int i = 0;
+    for (; i < n && ((unsigned long) (dst + i) & 15); i++)
+        dst[i] = src[i];
+    for (; i + 4 <= n; i += 4)
+        _mm_store_si128((__m128i *) (dst + i),
+                        _mm_loadu_si128((const __m128i *) (src + i)));
+    for (; i < n; i++)
+        dst[i] = src[i];
+}
+
+/*
+ * copyIntsAVX2 - Copy n ints eight at a time, aligning dst to 32 bytes.
+ */
+SHIFT_COPY_OPT __attribute__((target("avx2")))
+static void copyIntsAVX2(int *dst, const int *src, int n)
+{
+    int i = 0;
+    for (; i < n && ((unsigned long) (dst + i) & 31); i++)
+        dst[i] = src[i];
+    for (; i + 8 <= n; i += 8)
+        _mm256_store_si256((__m256i *) (dst + i),
+                           _mm256_loadu_si256((const __m256i *) (src + i)));
+    for (; i < n; i++)
+        dst[i] = src[i];
+}
+#endif
+
+/*
+ * The copy routines used by the vectorized shifts. They start out scalar
+ * and are resolved once by pickCopyInts(), from registerFunctions(), so
+ * the CPU feature checks run before any kernel is traced or timed.
+ */
+static copy_ints_t copy_ints_best = copyIntsScalar;
+static copy_ints_t copy_ints_sse2 = copyIntsScalar;
+
+/*
+ * pickCopyInts - Point the copy routines at the widest ones this CPU
+ *     supports.
+ */
+static void pickCopyInts()
+{
+#ifdef SHIFT_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        copy_ints_best = copy_ints_sse2 = copyIntsSSE2;
+    if (__builtin_cpu_supports("avx2"))
+        copy_ints_best = copyIntsAVX2;
+#endif
+}
+
+/*
+ * shiftWithCopy - Shift A up by one row using the given copy routine.
+ */
+static void shiftWithCopy(int M, int N, int A[M][N], copy_ints_t copy)
+{
+    if (M < 2)
+        return;
+    copy(rotate_row_buf, A[0], N);
+    copy(A[0], A[1], (M - 1) * N);
+    copy(A[M-1], rotate_row_buf, N);
+}
+
+/*
+ * matrix_shift_simd - Vectorized shift using the widest instruction set
+ *     available at runtime (AVX2, then SSE2, then scalar).
+ */
+char matrix_shift_simd_desc[] = "Vectorized shift (best available)";
+void matrix_shift_simd(int M, int N, int A[M][N], int s, int E, int b)
+{
+    shiftWithCopy(M, N, A, copy_ints_best);
+}
+
+/*
+ * matrix_shift_simd_sse2 - Vectorized shift limited to SSE2, so that the
+ *     four-wide path is validated even on AVX2 hosts.
+ */
+char matrix_shift_simd_sse2_desc[] = "Vectorized shift (SSE2)";
+void matrix_shift_simd_sse2(int M, int N, int A[M][N], int s, int E, int b)
+{
+    shiftWithCopy(M, N, A, copy_ints_sse2);
+}
+
+/*
+ * matrix_shift_simd_scalar - The scalar fallback of the vectorized shift.
+ */
+char matrix_shift_simd_scalar_desc[] = "Vectorized shift (scalar fallback)";
+void matrix_shift_simd_scalar(int M, int N, int A[M][N], int s, int E, int b)
+{
+    shiftWithCopy(M, N, A, copyIntsScalar);
+}
+
+/*
+ * Band-partitioned parallel shift. The rows are split into contiguous
+ * bands, one per thread. Before the bands start, the caller saves the
+ * first row of every band into band_edge_buf; those are the only rows a
+ * band needs from outside itself. Each band then moves its own rows up
+ * and fills its last row from the saved first row of the next band, the
+ * last band taking the saved row 0. No row is written by one thread
+ * while another reads it.
+ *
+ * Interior rows move exactly once, but the first row of every band moves
+ * twice: once into band_edge_buf and once into the band above. Splitting
+ * the single rotation cycle into T chains that run at the same time needs
+ * one saved row per chain, just as matrix_shift_rotate() saves row 0, so
+ * this is T extra row copies rather than the one-move-per-row ideal.
+ */
+#define MAX_SHIFT_THREADS 64
+
+static int band_edge_buf[MAX_SHIFT_THREADS][MAXN];
+static int shift_threads = 0; /* 0 means one per online CPU */
+
+/* Persistent worker pool; the calling thread always runs band 0 */
+static struct band_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    int num_workers;          /* workers started so far */
+    unsigned long generation; /* bumped for every job */
+    int pending;              /* bands still running in this job */
+    int bands;                /* number of bands in this job */
+    int M, N;
+    int *base;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, 0, 0, NULL };
+
+/*
+ * setShiftThreads - Set the number of threads used by the parallel shift.
+ *     Zero selects one thread per online CPU.
+ */
+void setShiftThreads(int n)
+{
+    shift_threads = n;
+}
+
+/*
+ * shiftBand - Shift the rows of band t of the current job.
+ */
+static void shiftBand(int t)
+{
+    int M = pool.M, N = pool.N, T = pool.bands;
+    int lo = t * M / T, hi = (t + 1) * M / T;
+    int *base = pool.base;
+    size_t row_bytes = (size_t) N * sizeof(int);
+
+    if (hi - lo > 1)
+        memmove(base + (size_t) lo * N, base + (size_t) (lo + 1) * N,
+                (hi - lo - 1) * row_bytes);
+    memcpy(base + (size_t) (hi - 1) * N, band_edge_buf[(t + 1) % T], row_bytes);
+}
+
+/*
+ * bandWorker - Worker thread body. Worker w runs band w + 1 of every job
+ *     that has more than w + 1 bands.
+ */
+static void *bandWorker(void *arg)
+{
+    int band = (int) (long) arg + 1;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == seen)
+            pthread_cond_wait(&pool.work_ready, &pool.lock);
+        seen = pool.generation;
+        if (band >= pool.bands)
+            continue;
+        pthread_mutex_unlock(&pool.lock);
+
+        shiftBand(band);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.pending == 0)
+            pthread_cond_signal(&pool.work_done);
+    }
+    return NULL;
+}
+
+/*
+ * matrix_shift_parallel - Shift with the rows split into bands across a
+ *     pool of threads. See the comment above band_edge_buf.
+ */
+char matrix_shift_parallel_desc[] = "Parallel band shift";
+void matrix_shift_parallel(int M, int N, int A[M][N], int s, int E, int b)
+{
+    int t, T = shift_threads;
+    pthread_t tid;
+
+    if (T <= 0)
+        T = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (T > MAX_SHIFT_THREADS)
+        T = MAX_SHIFT_THREADS;
+    if (T > M)
+        T = M;
+    if (T < 1)
+        T = 1;
+
+    for (t = 0; t < T; t++)
+        memcpy(band_edge_buf[t], A[t * M / T], (size_t) N * sizeof(int));
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.num_workers < T - 1) {
+        if (pthread_create(&tid, NULL, bandWorker, (void *) (long) pool.num_workers) != 0)
+            break;
+        pthread_detach(tid);
+        pool.num_workers++;
+    }
+    pool.M = M;
+    pool.N = N;
+    pool.base = &A[0][0];
+    pool.bands = T;
+    pool.pending = pool.num_workers < T - 1 ? pool.num_workers : T - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.work_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    /* Run band 0 and any bands we could not get a worker for here */
+    shiftBand(0);
+    for (t = pool.num_workers + 1; t < T; t++)
+        shiftBand(t);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.pending > 0)
+        pthread_cond_wait(&pool.work_done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * Tunable tiled shift. The rows from 1 to M-1 are cut into tiles of
+ * tile_h rows, and each tile is swept strip by strip, tile_w columns at a
+ * time, with the same swap chain as matrix_shift_submit(). Each strip's
+ * chain still advances in row order, so any tiling is correct. The
+ * family also holds the column carry of matrix_shift_submit(), which
+ * walks each column bottom-up and wins when a column stays resident, as
+ * in direct-mapped caches. The autotuner in test-shift picks the
+ * parameters and records them in shift-tuned.h for matrix_shift_tuned().
+ */
+
+/*
+ * defaultShiftParams - Parameters used when a configuration has not been
+ *     tuned: one-block strips down the full height.
+ */
+void defaultShiftParams(int M, int N, int s, int E, int b, shift_params_t *p)
+{
+    p->tile_w = (1 << b) / (int) sizeof(int);
+    if (p->tile_w < 1)
+        p->tile_w = 1;
+    p->tile_h = M;
+    p->unroll = 1;
+    p->carry = 0;
+}
+
+/*
+ * shiftTiled - Shift A with the given tile parameters.
+ */
+void shiftTiled(int M, int N, int A[M][N], const shift_params_t *p)
+{
+    register int *row, *stop, *prev, *cur, *end;
+    register int u, v, n = N;
+    int *base = &A[0][0];
+    int r0, r1, j, w;
+
+    if (p->carry) {
+        for (j = 0; j < N; j++) {
+            stop = base + j;
+            u = *stop;
+            for (cur = stop + (M-1)*N; cur >= stop; cur -= n) {
+                v = *cur;
+                *cur = u;
+                u = v;
+            }
+        }
+        return;
+    }
+
+    for (r0 = 1; r0 < M; r0 = r1) {
+        r1 = M - r0 > p->tile_h ? r0 + p->tile_h : M;
+        for (j = 0; j < N; j += p->tile_w) {
+            w = N - j > p->tile_w ? p->tile_w : N - j;
+            stop = base + (r1-1)*N + j;
+            for (row = base + (r0-1)*N + j; row < stop; row += n) {
+                prev = row;
+                cur = row + n;
+                end = cur + w;
+                if (p->unroll >= 4) {
+                    for (; cur + 4 <= end; prev += 4, cur += 4) {
+                        u = prev[0]; v = cur[0]; prev[0] = v; cur[0] = u;
+                        u = prev[1]; v = cur[1]; prev[1] = v; cur[1] = u;
+                        u = prev[2]; v = cur[2]; prev[2] = v; cur[2] = u;
+                        u = prev[3]; v = cur[3]; prev[3] = v; cur[3] = u;
+                    }
+                }
+                if (p->unroll >= 2) {
+                    for (; cur + 2 <= end; prev += 2, cur += 2) {
+                        u = prev[0]; v = cur[0]; prev[0] = v; cur[0] = u;
+                        u = prev[1]; v = cur[1]; prev[1] = v; cur[1] = u;
+                    }
+                }
+                for (; cur < end; prev++, cur++) {
+                    u = *prev;
+                    v = *cur;
+                    *prev = v;
+                    *cur = u;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * replayTiled - Feed the accesses shiftTiled() makes to A, with A placed
+ *     at address base, into the simulated cache. The loops must mirror
+ *     shiftTiled(); unrolling does not change the access order. Stops
+ *     early and returns once the miss count exceeds limit.
+ */
+unsigned long long int replayTiled(int M, int N, unsigned long long int base,
+                                   const shift_params_t *p, sim_cache_t *c,
+                                   unsigned long long int limit)
+{
+    unsigned long long int prev, cur;
+    int r0, r1, i, j, k, w;
+
+    if (p->carry) {
+        for (j = 0; j < N; j++) {
+            cur = base + (unsigned long long int) j * sizeof(int);
+            simCacheAccess(c, cur);
+            for (i = M - 1; i >= 0; i--) {
+                simCacheAccess(c, cur + (unsigned long long int) i * N * sizeof(int));
+                simCacheAccess(c, cur + (unsigned long long int) i * N * sizeof(int));
+            }
+            if (c->misses > limit)
+                return c->misses;
+        }
+        return c->misses;
+    }
+
+    for (r0 = 1; r0 < M; r0 = r1) {
+        r1 = M - r0 > p->tile_h ? r0 + p->tile_h : M;
+        for (j = 0; j < N; j += p->tile_w) {
+            w = N - j > p->tile_w ? p->tile_w : N - j;
+            for (i = r0; i < r1; i++) {
+                prev = base + ((unsigned long long int) (i-1) * N + j) * sizeof(int);
+                cur = prev + (unsigned long long int) N * sizeof(int);
+                for (k = 0; k < w; k++, prev += sizeof(int), cur += sizeof(int)) {
+                    simCacheAccess(c, prev);
+                    simCacheAccess(c, cur);
+                    simCacheAccess(c, prev);
+                    simCacheAccess(c, cur);
+                }
+                if (c->misses > limit)
+                    return c->misses;
+            }
+        }
+    }
+    return c->misses;
+}
+
+/*
+ * lookupShiftParams - Find the tuned parameters for this configuration
+ *     in shift-tuned.h, falling back to defaultShiftParams().
+ */
+void lookupShiftParams(int M, int N, int s, int E, int b, shift_params_t *p)
+{
+    const shift_tuning_t *t;
+    for (t = shift_tuning_table; t->M != 0; t++) {
+        if (t->M == M && t->N == N && t->s == s && t->E == E && t->b == b) {
+            *p = t->params;
+            return;
+        }
+    }
+    defaultShiftParams(M, N, s, E, b, p);
+}
+
+/*
+ * matrix_shift_tuned - Tiled shift using the autotuned parameters.
+ */
+char matrix_shift_tuned_desc[] = "Autotuned tiled shift";
+void matrix_shift_tuned(int M, int N, int A[M][N], int s, int E, int b)
+{
+    shift_params_t params;
+    lookupShiftParams(M, N, s, E, b, &params);
+    shiftTiled(M, N, A, &params);
+}
+
+/*
+ * matrix_shift_generated - Run the straight-line kernel from shift-gen.h
+ *     written for exactly this (M, N, s, E, b), or the submission when
+ *     shiftgen has not been run for it.
+ */
+char matrix_shift_generated_desc[] = "Generated shift dispatcher";
+void matrix_shift_generated(int M, int N, int A[M][N], int s, int E, int b)
+{
+    const shift_generated_t *g;
+    for (g = shift_generated_table; g->M != 0; g++) {
+        if (g->M == M && g->N == N && g->s == s && g->E == E && g->b == b) {
+            (*g->func_ptr)(M, N, A, s, E, b);
+            return;
+        }
+    }
+    matrix_shift_submit(M, N, A, s, E, b);
+}
+
 /*
  * registerFunctions - This function registers your matrix shift
  *     functions with the driver.  At runtime, the driver will
@@ -76,4 +668,19 @@ void registerFunctions()
 
     /* Register any additional matrix shift functions */
     registerShiftFunction(matrix_shift_function1, matrix_shift_function_desc1);
+    registerShiftFunction(matrix_shift_rotate, matrix_shift_rotate_desc);
+    registerShiftFunction(matrix_shift_rotate_k, matrix_shift_rotate_k_desc);
+    registerShiftFunction(matrix_shift_simd, matrix_shift_simd_desc);
+    registerShiftFunction(matrix_shift_simd_sse2, matrix_shift_simd_sse2_desc);
+    registerShiftFunction(matrix_shift_simd_scalar, matrix_shift_simd_scalar_desc);
+    registerShiftFunction(matrix_shift_parallel, matrix_shift_parallel_desc);
+    registerShiftFunction(matrix_shift_tuned, matrix_shift_tuned_desc);
+    registerShiftFunction(matrix_shift_generated, matrix_shift_generated_desc);
+    registerGeneratedShifts();
+    pickCopyInts();
+
+    /* Static buffers the kernels use besides A. They are registered here,
+       outside the traced and timed region, at their full size. */
+    registerScratchBuffer(rotate_row_buf, sizeof(rotate_row_buf), "rotate row buffer");
+    registerScratchBuffer(band_edge_buf, sizeof(band_edge_buf), "band edge rows");
 }
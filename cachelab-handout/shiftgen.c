@@ -0,0 +1,241 @@
+/*
+ * shiftgen.c - Generates straight-line matrix shift kernels for fixed
+ *     matrix shapes and cache geometries.
+ *
+ * For each configuration MxN:s,E,b given on the command line, shiftgen
+ * tries every strip width and both write orders of the swap chain used
+ * by matrix_shift_submit(), scores each order by replaying it through an
+ * in-process LRU cache, and writes the best one out as a fully unrolled
+ * kernel with every index a constant. The output header also holds the
+ * table matrix_shift_generated() dispatches on and the registration glue
+ * called from registerFunctions().
+ *
+ * Example: ./shiftgen -o shift-gen.h 4x4:1,2,3 8x8:2,2,3
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+#include "cachelab.h"
+
+/* Largest matrix (in elements) we are willing to unroll completely */
+#define SHIFTGEN_MAX_ELEMS 4096
+
+/* Maximum number of configurations in one header */
+#define SHIFTGEN_MAX_CONFIGS 64
+
+/* A configuration and the access order chosen for it */
+typedef struct gen_config {
+    int M, N, s, E, b;
+    int width;        /* strip width in ints */
+    int lower_last;   /* write the lower row of each pair last */
+    unsigned long long int misses;
+} gen_config_t;
+
+static gen_config_t configs[SHIFTGEN_MAX_CONFIGS];
+static int num_configs = 0;
+
+/*
+ * forEachSwap - Visit the element pairs (upper, lower) of the swap chain
+ *     in strip order, calling emit or feeding the cache for each one.
+ *     Exactly one of fp and c is used.
+ */
+static void forEachSwap(gen_config_t *g, FILE *fp, sim_cache_t *c)
+{
+    int i, j, k, w;
+    int up, lo;
+
+    for (j = 0; j < g->N; j += g->width) {
+        w = g->N - j > g->width ? g->width : g->N - j;
+        for (i = 1; i < g->M; i++) {
+            for (k = j; k < j + w; k++) {
+                up = (i-1) * g->N + k;
+                lo = i * g->N + k;
+                if (fp && g->lower_last)
+                    fprintf(fp, "    u = a[%d]; v = a[%d]; a[%d] = v; a[%d] = u;\n",
+                            up, lo, up, lo);
+                else if (fp)
+                    fprintf(fp, "    v = a[%d]; u = a[%d]; a[%d] = u; a[%d] = v;\n",
+                            lo, up, lo, up);
+                else if (g->lower_last) {
+                    simCacheAccess(c, up * sizeof(int));
+                    simCacheAccess(c, lo * sizeof(int));
+                    simCacheAccess(c, up * sizeof(int));
+                    simCacheAccess(c, lo * sizeof(int));
+                } else {
+                    simCacheAccess(c, lo * sizeof(int));
+                    simCacheAccess(c, up * sizeof(int));
+                    simCacheAccess(c, lo * sizeof(int));
+                    simCacheAccess(c, up * sizeof(int));
+                }
+            }
+        }
+    }
+}
+
+/*
+ * chooseOrder - Pick the strip width and write order with the fewest
+ *     simulated misses, preferring wider strips on ties. A is assumed to
+ *     start on a boundary of every cache geometry.
+ */
+static void chooseOrder(gen_config_t *g)
+{
+    gen_config_t trial = *g;
+    sim_cache_t c;
+    int w, last;
+
+    g->misses = ULLONG_MAX;
+    for (w = 1; ; w = w * 2 < g->N ? w * 2 : g->N) {
+        for (last = 0; last <= 1; last++) {
+            trial.width = w;
+            trial.lower_last = last;
+            simCacheInit(&c, g->s, g->E, g->b);
+            forEachSwap(&trial, NULL, &c);
+            if (c.misses <= g->misses) {
+                g->width = w;
+                g->lower_last = last;
+                g->misses = c.misses;
+            }
+            simCacheFree(&c);
+        }
+        if (w == g->N)
+            break;
+    }
+}
+
+/*
+ * emitHeader - Write every configuration as a kernel, then the dispatch
+ *     table and the registration function.
+ */
+static void emitHeader(FILE *fp)
+{
+    int i;
+    gen_config_t *g;
+
+    fprintf(fp, "/*\n"
+            " * File:        shift-gen.h\n"
+            " * Description: Straight-line shift kernels for fixed (M, N, s, E, b),\n"
+            " *              written by ./shiftgen. Regenerate instead of editing.\n"
+            " */\n"
+            "void matrix_shift_submit(int M, int N, int A[M][N], int s, int E, int b);\n");
+
+    for (i = 0; i < num_configs; i++) {
+        g = &configs[i];
+        fprintf(fp, "\n/* %dx%d, s=%d E=%d b=%d: strip width %d, %s row written last, "
+                "%llu misses simulated */\n",
+                g->M, g->N, g->s, g->E, g->b, g->width,
+                g->lower_last ? "lower" : "upper", g->misses);
+        fprintf(fp, "static char shift_gen_%dx%d_s%d_E%d_b%d_desc[] = "
+                "\"Generated shift %dx%d s=%d E=%d b=%d\";\n",
+                g->M, g->N, g->s, g->E, g->b, g->M, g->N, g->s, g->E, g->b);
+        fprintf(fp, "static void shift_gen_%dx%d_s%d_E%d_b%d"
+                "(int M, int N, int A[M][N], int s, int E, int b)\n{\n",
+                g->M, g->N, g->s, g->E, g->b);
+        fprintf(fp, "    register int *a = &A[0][0];\n"
+                "    register int u, v;\n\n"
+                "    if (M != %d || N != %d) {\n"
+                "        matrix_shift_submit(M, N, A, s, E, b);\n"
+                "        return;\n"
+                "    }\n", g->M, g->N);
+        forEachSwap(g, fp, NULL);
+        fprintf(fp, "}\n");
+    }
+
+    fprintf(fp, "\nstatic const shift_generated_t shift_generated_table[] = {\n");
+    for (i = 0; i < num_configs; i++) {
+        g = &configs[i];
+        fprintf(fp, "    { %d, %d, %d, %d, %d, shift_gen_%dx%d_s%d_E%d_b%d },\n",
+                g->M, g->N, g->s, g->E, g->b, g->M, g->N, g->s, g->E, g->b);
+    }
+    fprintf(fp, "    { 0 }\n};\n");
+
+    fprintf(fp, "\n/* Called from registerFunctions() */\n"
+            "static void registerGeneratedShifts()\n{\n");
+    for (i = 0; i < num_configs; i++) {
+        g = &configs[i];
+        fprintf(fp, "    registerShiftFunction(shift_gen_%dx%d_s%d_E%d_b%d, "
+                "shift_gen_%dx%d_s%d_E%d_b%d_desc);\n",
+                g->M, g->N, g->s, g->E, g->b, g->M, g->N, g->s, g->E, g->b);
+    }
+    fprintf(fp, "}\n");
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-o <file>] <M>x<N>:<s>,<E>,<b> ...\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -o <file>   Output header (default shift-gen.h)\n");
+    printf("Matrices are limited to %d elements.\n", SHIFTGEN_MAX_ELEMS);
+    printf("Example: %s -o shift-gen.h 4x4:1,2,3 8x8:2,2,3\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char c;
+    char *out_file = "shift-gen.h";
+    gen_config_t *g;
+    FILE *fp;
+    int i, k;
+
+    while ((c = getopt(argc, argv, "o:h")) != -1) {
+        switch (c) {
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (num_configs == SHIFTGEN_MAX_CONFIGS) {
+            printf("Error: At most %d configurations\n", SHIFTGEN_MAX_CONFIGS);
+            exit(1);
+        }
+        g = &configs[num_configs];
+        if (sscanf(argv[i], "%dx%d:%d,%d,%d", &g->M, &g->N, &g->s, &g->E, &g->b) != 5 ||
+            g->M < 1 || g->N < 1 || g->s < 0 || g->E < 1 || g->b < 0) {
+            printf("Error: Cannot parse configuration \"%s\"\n", argv[i]);
+            usage(argv);
+            exit(1);
+        }
+        for (k = 0; k < num_configs; k++) {
+            if (configs[k].M == g->M && configs[k].N == g->N && configs[k].s == g->s &&
+                configs[k].E == g->E && configs[k].b == g->b) {
+                printf("Error: Configuration \"%s\" given twice\n", argv[i]);
+                exit(1);
+            }
+        }
+        if (g->M * g->N > SHIFTGEN_MAX_ELEMS) {
+            printf("Error: %dx%d exceeds %d elements\n", g->M, g->N, SHIFTGEN_MAX_ELEMS);
+            exit(1);
+        }
+        chooseOrder(g);
+        printf("%dx%d s=%d E=%d b=%d: strip width %d, %s row last, misses=%llu\n",
+               g->M, g->N, g->s, g->E, g->b, g->width,
+               g->lower_last ? "lower" : "upper", g->misses);
+        num_configs++;
+    }
+
+    if (num_configs == 0) {
+        printf("Error: Missing configuration\n");
+        usage(argv);
+        exit(1);
+    }
+
+    fp = fopen(out_file, "w");
+    assert(fp);
+    emitHeader(fp);
+    fclose(fp);
+    return 0;
+}
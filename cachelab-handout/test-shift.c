@@ -3,6 +3,7 @@
  *     student's matrix wavefront shiftport functions and records the results for their
  *     official submitted version as well.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,16 +15,44 @@
 #include "cachelab.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
-
-/* Maximum array dimension */
-#define MAXN 1024
+#include <time.h> // for clock_gettime
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <emmintrin.h> // for _mm_clflush
+#endif
 
 /* The description string for the matrix_shift_submit() function that the
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Matrix shift submission"
 
-/* External function defined in shift.c */
+/* External functions defined in shift.c */
 extern void registerFunctions();
+extern void setShiftThreads(int n);
+extern void matrix_shift_parallel(int M, int N, int A[M][N], int s, int E, int b);
+extern void defaultShiftParams(int M, int N, int s, int E, int b, shift_params_t *p);
+extern void shiftTiled(int M, int N, int A[M][N], const shift_params_t *p);
+extern unsigned long long int replayTiled(int M, int N, unsigned long long int base,
+                                          const shift_params_t *p, sim_cache_t *c,
+                                          unsigned long long int limit);
+
+/* Number of timed runs per thread count in the parallel timing mode */
+#define PARALLEL_REPS 20
+
+/* Default number of timed runs per function in the native benchmark mode */
+#define NATIVE_REPS 101
+
+/* Maximum number of rows kept in the autotuner's table */
+#define MAX_TUNING_ROWS 256
+
+/* Address the autotuner places A at; aligned to any cache geometry */
+#define TUNE_BASE 0ULL
+
+/* Bytes swept to evict the caches when clflush is not available */
+#define FLUSH_BYTES (64 * 1024 * 1024)
 
 /* External variables defined in cachelab-tools.c */
 extern shift_funct_t func_list[MAX_SHIFT_FUNCS];
@@ -35,6 +64,13 @@ static int N = 0;
 static int s = 0;
 static int E = 0;
 static int b = 0;
+static int max_threads = 0;
+static int native_reps = 0;
+static char *tune_file = NULL;
+static unsigned int seed = DEFAULT_SEED;
+
+/* Matrix layout options passed through to tracegen */
+static char layout_args[256] = "";
 
 /* The correctness and performance for the submitted matrix shift function */
 struct results {
@@ -44,15 +80,125 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/* Address ranges published by tracegen in .marker */
+static trace_region_t regions[MAX_TRACE_REGIONS];
+static int num_regions = 0;
+static char layout[256];
+
+/*
+ * readMarkers - Read the marker addresses and the regions of interest
+ *     written by tracegen.
+ */
+void readMarkers(unsigned long long int *marker_start,
+                 unsigned long long int *marker_end)
+{
+    FILE* marker_fp = fopen(".marker", "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx", marker_start, marker_end);
+    num_regions = 0;
+    while (num_regions < MAX_TRACE_REGIONS &&
+           fscanf(marker_fp, "%llx %llx %63[^\n]",
+                  &regions[num_regions].start, &regions[num_regions].end,
+                  regions[num_regions].name) == 3) {
+        regions[num_regions].num_accesses = 0;
+        num_regions++;
+    }
+    if (fscanf(marker_fp, " layout %255[^\n]", layout) != 1)
+        strcpy(layout, "unknown");
+    fclose(marker_fp);
+}
+
+/*
+ * findRegion - Return the index of the region holding addr, or -1.
+ */
+static int findRegion(unsigned long long int addr)
+{
+    int r;
+    for (r = 0; r < num_regions; r++) {
+        if (addr >= regions[r].start && addr < regions[r].end)
+            return r;
+    }
+    return -1;
+}
+
+/*
+ * filterTrace - Copy the accesses between the start and end markers that
+ *     fall inside one of the regions of interest, and report how many
+ *     block accesses each region contributed. csim-ref ignores the size
+ *     of an access, so a vector load or store that spans several 2^b
+ *     byte blocks is split into one line per block it touches.
+ */
+void filterTrace(FILE* full_trace_fp, FILE* part_trace_fp,
+                 unsigned long long int marker_start,
+                 unsigned long long int marker_end, unsigned int b)
+{
+    int r, flag = 0;
+    unsigned int len;
+    unsigned long long int addr, end, lo, hi, dropped = 0;
+    char buf[1000];
+
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+
+            /* If start marker found, set flag */
+            if (addr == marker_start) {
+                flag = 1;
+                continue;
+            }
+
+            /* if end marker found, stop */
+            if (addr == marker_end)
+                break;
+
+            /* Valgrind creates many spurious accesses that have
+               nothing to do with the students code. Keep only the
+               accesses to the matrices, the shift function's own
+               stack frames and its registered scratch buffers. */
+            if (flag) {
+                r = findRegion(addr);
+                if (r < 0) {
+                    dropped++;
+                    continue;
+                }
+                end = addr + (len ? len : 1);
+                if (((end - 1) >> b) == (addr >> b)) {
+                    regions[r].num_accesses++;
+                    fputs(buf, part_trace_fp);
+                    continue;
+                }
+                for (lo = addr; lo < end; lo = hi) {
+                    hi = ((lo >> b) + 1) << b;
+                    if (hi > end)
+                        hi = end;
+                    regions[r].num_accesses++;
+                    fprintf(part_trace_fp, " %c %llx,%llu\n", buf[1], lo, hi - lo);
+                }
+            }
+        }
+    }
+    fclose(part_trace_fp);
+
+    for (r = 0; r < num_regions; r++) {
+        printf("  region %-24s [%llx, %llx): %llu accesses\n", regions[r].name,
+               regions[r].start, regions[r].end, regions[r].num_accesses);
+    }
+    printf("  filtered out: %llu accesses\n", dropped);
+    printf("  matrix layout: %s\n", layout);
+}
+
 /*
  * eval_perf - Evaluate the performance of the registered matrix shift functions
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
     int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[1023];
+    unsigned int hits, misses, evictions;
+    unsigned long long int marker_start, marker_end;
+    char cmd[1023];
     char filename[128];
 
     registerFunctions();
@@ -71,18 +217,15 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
         printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
         /* Use valgrind to generate the trace */
 
-       sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d  > trace.tmp", M, N,s,E,b,i);
+       sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d -S %u%s > trace.tmp", M, N,s,E,b,i,seed,layout_args);
         flag=WEXITSTATUS(system(cmd));
         if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,s,E,b,i);
+            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d -S %u%s for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,s,E,b,i,seed,layout_args);
             continue;
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
+        /* Get the start and end marker addresses and regions of interest */
+        readMarkers(&marker_start, &marker_end);
 
 
         func_list[i].correct=1;
@@ -102,39 +245,7 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
         assert(part_trace_fp);
 
         /* Locate trace corresponding to the shift function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
+        filterTrace(full_trace_fp, part_trace_fp, marker_start, marker_end, b);
         fclose(full_trace_fp);
 
         /* Run the reference simulator */
@@ -167,9 +278,9 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 void eval_perf_new(unsigned int s, unsigned int E, unsigned int b)
 {
     int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[1023];
+    unsigned int hits, misses, evictions;
+    unsigned long long int marker_start, marker_end;
+    char cmd[1023];
     char filename[128];
 
     func_counter = 0;  //so that next time the func_counter starts from 0 only
@@ -189,18 +300,15 @@ void eval_perf_new(unsigned int s, unsigned int E, unsigned int b)
         printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
         /* Use valgrind to generate the trace */
 
-       sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d > trace.tmp", M, N,s,E,b,i);
+       sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d -S %u%s > trace.tmp", M, N,s,E,b,i,seed,layout_args);
         flag=WEXITSTATUS(system(cmd));
         if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,s,E,b,i);
+            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -s %d -E %d -b %d -F %d -S %u%s for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,s,E,b,i,seed,layout_args);
             continue;
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
+        /* Get the start and end marker addresses and regions of interest */
+        readMarkers(&marker_start, &marker_end);
 
 
         func_list[i].correct=1;
@@ -220,39 +328,7 @@ void eval_perf_new(unsigned int s, unsigned int E, unsigned int b)
         assert(part_trace_fp);
 
         /* Locate trace corresponding to the shift function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
+        filterTrace(full_trace_fp, part_trace_fp, marker_start, marker_end, b);
         fclose(full_trace_fp);
 
         /* Run the reference simulator */
@@ -281,6 +357,436 @@ void eval_perf_new(unsigned int s, unsigned int E, unsigned int b)
 
 }
 
+/*
+ * now_ns - Monotonic wall-clock time in nanoseconds
+ */
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * eval_parallel - Time matrix_shift_parallel() natively for 1..max_threads
+ *     threads and report the speedup over a single thread. The cache
+ *     simulator replays a single access stream, so it cannot show how
+ *     the bands scale.
+ */
+void eval_parallel(int max_threads)
+{
+    int t, r, i, j;
+    double start, ns, base_ns = 0;
+    int (*A)[N] = malloc(sizeof(int) * M * N);
+    int (*C)[N] = malloc(sizeof(int) * M * N);
+    assert(A && C);
+
+    initMatrix(M, N, A, seed);
+    printf("Parallel band shift, %dx%d, %d runs per thread count\n",
+           M, N, PARALLEL_REPS);
+    printf("%8s %12s %10s %8s\n", "threads", "ns/shift", "GB/s", "speedup");
+
+    for (t = 1; t <= max_threads; t++) {
+        setShiftThreads(t);
+
+        /* Validate against the reference before timing */
+        memcpy(C, A, sizeof(int) * M * N);
+        correctShift(M, N, C, s, E, b);
+        matrix_shift_parallel(M, N, A, s, E, b);
+        for (i = 0; i < M; i++) {
+            for (j = 0; j < N; j++) {
+                if (A[i][j] != C[i][j]) {
+                    printf("Validation failed with %d threads at A[%d][%d]\n", t, i, j);
+                    exit(1);
+                }
+            }
+        }
+
+        start = now_ns();
+        for (r = 0; r < PARALLEL_REPS; r++)
+            matrix_shift_parallel(M, N, A, s, E, b);
+        ns = (now_ns() - start) / PARALLEL_REPS;
+        if (t == 1)
+            base_ns = ns;
+
+        /* Every element is read once and written once */
+        printf("%8d %12.0f %10.2f %8.2f\n", t, ns,
+               2.0 * sizeof(int) * M * N / ns, base_ns / ns);
+    }
+    free(A);
+    free(C);
+}
+
+/*
+ * Hardware cache-miss counters for the native benchmark. Each counter is
+ * -1 when perf_event_open is unavailable or refuses the event; the
+ * counters follow the calling thread only.
+ */
+#define NUM_HW_COUNTERS 2
+static const char *hw_counter_names[NUM_HW_COUNTERS] = { "L1D", "LLC" };
+
+void open_hw_counters(int fd[NUM_HW_COUNTERS])
+{
+    int i;
+    for (i = 0; i < NUM_HW_COUNTERS; i++)
+        fd[i] = -1;
+#ifdef __linux__
+    struct perf_event_attr attr;
+    for (i = 0; i < NUM_HW_COUNTERS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        if (i == 0) {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        } else {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+void close_hw_counters(int fd[NUM_HW_COUNTERS])
+{
+    int i;
+    for (i = 0; i < NUM_HW_COUNTERS; i++)
+        if (fd[i] >= 0)
+            close(fd[i]);
+}
+
+/* Start (on != 0) or stop all open counters */
+void toggle_hw_counters(int fd[NUM_HW_COUNTERS], int on)
+{
+#ifdef __linux__
+    int i;
+    for (i = 0; i < NUM_HW_COUNTERS; i++)
+        if (fd[i] >= 0)
+            ioctl(fd[i], on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#endif
+}
+
+/* Read the open counters into count[], resetting them to zero */
+void read_hw_counters(int fd[NUM_HW_COUNTERS], long long count[NUM_HW_COUNTERS])
+{
+    int i;
+    for (i = 0; i < NUM_HW_COUNTERS; i++) {
+        count[i] = -1;
+        if (fd[i] < 0 || read(fd[i], &count[i], sizeof(count[i])) != sizeof(count[i]))
+            count[i] = -1;
+#ifdef __linux__
+        if (fd[i] >= 0)
+            ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+#endif
+    }
+}
+
+/*
+ * flush_cache - Evict the matrix from every cache level. Uses clflush on
+ *     x86 and otherwise sweeps a buffer larger than any last-level cache.
+ */
+void flush_cache(void *p, size_t bytes)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    char *c;
+    for (c = p; c < (char *) p + bytes; c += 64)
+        _mm_clflush(c);
+    _mm_mfence();
+#else
+    static volatile char *sweep = NULL;
+    size_t i;
+    if (!sweep) {
+        sweep = malloc(FLUSH_BYTES);
+        assert(sweep);
+    }
+    for (i = 0; i < FLUSH_BYTES; i += 64)
+        sweep[i]++;
+#endif
+}
+
+static int cmp_double(const void *x, const void *y)
+{
+    double a = *(const double *) x, b = *(const double *) y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * bench_one - Run func reps times on A, optionally flushing the caches
+ *     before each run, and print timing percentiles and miss counts.
+ */
+void bench_one(int fn, int (*A)[N], int reps, int cold, int fd[NUM_HW_COUNTERS])
+{
+    int r, i;
+    double start, median;
+    double *ns = malloc(sizeof(double) * reps);
+    long long count[NUM_HW_COUNTERS], total[NUM_HW_COUNTERS] = { 0 };
+    double elems = (double) M * N;
+    assert(ns);
+
+    /* One untimed run so the warm case starts warm */
+    if (!cold)
+        (*func_list[fn].func_ptr)(M, N, A, s, E, b);
+
+    for (r = 0; r < reps; r++) {
+        if (cold)
+            flush_cache(A, sizeof(int) * M * N);
+        read_hw_counters(fd, count);
+        toggle_hw_counters(fd, 1);
+        start = now_ns();
+        (*func_list[fn].func_ptr)(M, N, A, s, E, b);
+        ns[r] = now_ns() - start;
+        toggle_hw_counters(fd, 0);
+        read_hw_counters(fd, count);
+        for (i = 0; i < NUM_HW_COUNTERS; i++)
+            total[i] = (count[i] < 0 || total[i] < 0) ? -1 : total[i] + count[i];
+    }
+    qsort(ns, reps, sizeof(double), cmp_double);
+    median = ns[reps / 2];
+
+    /* Every element is read once and written once */
+    printf("  %-4s median %7.3f p90 %7.3f p99 %7.3f ns/elem  %7.2f GB/s",
+           cold ? "cold" : "warm", median / elems, ns[reps * 9 / 10] / elems,
+           ns[reps * 99 / 100] / elems, 2.0 * sizeof(int) * elems / median);
+    for (i = 0; i < NUM_HW_COUNTERS; i++) {
+        if (total[i] < 0)
+            printf("  %s misses n/a", hw_counter_names[i]);
+        else
+            printf("  %s misses %.0f", hw_counter_names[i], (double) total[i] / reps);
+    }
+    printf("\n");
+    free(ns);
+}
+
+/*
+ * eval_native - Time every registered shift function natively on warm
+ *     and cold matrices. The simulated misses only predict performance,
+ *     this shows whether they turn into real speedups.
+ */
+void eval_native(int reps)
+{
+    int i, fd[NUM_HW_COUNTERS];
+    int (*A)[N] = malloc(sizeof(int) * M * N);
+    assert(A);
+
+    registerFunctions();
+    initMatrix(M, N, A, seed);
+    open_hw_counters(fd);
+
+    printf("Native benchmark, %dx%d (s=%d E=%d b=%d), %d runs per function\n",
+           M, N, s, E, b, reps);
+    for (i = 0; i < func_counter; i++) {
+        printf("func %d (%s):\n", i, func_list[i].description);
+        bench_one(i, A, reps, 0, fd);
+        bench_one(i, A, reps, 1, fd);
+    }
+
+    close_hw_counters(fd);
+    free(A);
+}
+
+/* Rows of the tuning table, with the simulated misses of each */
+static shift_tuning_t tuning_rows[MAX_TUNING_ROWS];
+static unsigned long long int tuning_misses[MAX_TUNING_ROWS];
+static int num_tuning_rows = 0;
+
+/*
+ * read_tuning_table - Load the rows of an existing tuning table, if any.
+ */
+void read_tuning_table(char *fn)
+{
+    char buf[1000];
+    shift_tuning_t *t;
+    FILE *fp = fopen(fn, "r");
+
+    num_tuning_rows = 0;
+    if (!fp)
+        return;
+    while (fgets(buf, 1000, fp) != NULL && num_tuning_rows < MAX_TUNING_ROWS) {
+        t = &tuning_rows[num_tuning_rows];
+        if (sscanf(buf, " { %d, %d, %d, %d, %d, { %d, %d, %d, %d } }, /* misses %llu */",
+                   &t->M, &t->N, &t->s, &t->E, &t->b, &t->params.tile_w,
+                   &t->params.tile_h, &t->params.unroll, &t->params.carry,
+                   &tuning_misses[num_tuning_rows]) == 10)
+            num_tuning_rows++;
+    }
+    fclose(fp);
+}
+
+/*
+ * write_tuning_table - Write the tuning table as a C header for shift.c.
+ */
+void write_tuning_table(char *fn)
+{
+    int i;
+    shift_tuning_t *t;
+    FILE *fp = fopen(fn, "w");
+    assert(fp);
+
+    fprintf(fp, "/*\n"
+            " * File:        shift-tuned.h\n"
+            " * Description: Tile parameters for matrix_shift_tuned(), one row per\n"
+            " *              (M, N, s, E, b). Written by ./test-shift -T; rerun the\n"
+            " *              tuner rather than editing rows by hand.\n"
+            " */\n"
+            "static const shift_tuning_t shift_tuning_table[] = {\n");
+    for (i = 0; i < num_tuning_rows; i++) {
+        t = &tuning_rows[i];
+        fprintf(fp, "    { %d, %d, %d, %d, %d, { %d, %d, %d, %d } }, /* misses %llu */\n",
+                t->M, t->N, t->s, t->E, t->b, t->params.tile_w,
+                t->params.tile_h, t->params.unroll, t->params.carry,
+                tuning_misses[i]);
+    }
+    fprintf(fp, "    { 0 }\n};\n");
+    fclose(fp);
+}
+
+/*
+ * score_params - Simulated misses of the tiled shift with parameters p,
+ *     or some count above limit if it is worse than limit.
+ */
+static unsigned long long int score_params(const shift_params_t *p,
+                                           unsigned long long int limit)
+{
+    unsigned long long int misses;
+    sim_cache_t c;
+
+    simCacheInit(&c, s, E, b);
+    misses = replayTiled(M, N, TUNE_BASE, p, &c, limit);
+    simCacheFree(&c);
+    return misses;
+}
+
+/*
+ * prefer_params - Tie break between parameters with equal misses: more
+ *     unrolling, then wider and taller tiles, which run faster natively.
+ */
+static int prefer_params(const shift_params_t *x, const shift_params_t *y)
+{
+    if (x->unroll != y->unroll)
+        return x->unroll > y->unroll;
+    if (x->tile_w != y->tile_w)
+        return x->tile_w > y->tile_w;
+    return x->tile_h > y->tile_h;
+}
+
+/*
+ * eval_tune - Search the tile parameters of the tiled shift for the
+ *     configuration on the command line by coordinate descent. Each
+ *     candidate is scored by replaying its accesses through an in-process
+ *     LRU cache, abandoning the replay as soon as it falls behind the best
+ *     so far. The column carry has no tile parameters and is scored once
+ *     against the best tiling. The winner is checked natively and merged
+ *     into table_file.
+ */
+void eval_tune(char *table_file)
+{
+    int cand[3][64], ncand[3] = { 0, 0, 0 };
+    int d, k, i, j, v, improved, evals = 0;
+    int bw = (1 << b) / (int) sizeof(int);
+    unsigned long long int m, best_m;
+    shift_params_t best, trial;
+    int *field;
+
+    if (bw < 1)
+        bw = 1;
+    for (v = bw; v < N; v *= 2)
+        cand[0][ncand[0]++] = v;
+    cand[0][ncand[0]++] = N;
+    for (v = 1; v < M - 1; v *= 2)
+        cand[1][ncand[1]++] = v;
+    cand[1][ncand[1]++] = M;
+    for (v = 1; v <= 4; v *= 2)
+        cand[2][ncand[2]++] = v;
+
+    defaultShiftParams(M, N, s, E, b, &best);
+    best_m = score_params(&best, ULLONG_MAX);
+    evals++;
+    printf("Tuning %dx%d for s=%d E=%d b=%d, default: misses=%llu\n",
+           M, N, s, E, b, best_m);
+
+    do {
+        improved = 0;
+        for (d = 0; d < 3; d++) {
+            for (k = 0; k < ncand[d]; k++) {
+                trial = best;
+                field = d == 0 ? &trial.tile_w : d == 1 ? &trial.tile_h : &trial.unroll;
+                if (*field == cand[d][k])
+                    continue;
+                *field = cand[d][k];
+                m = score_params(&trial, best_m);
+                evals++;
+                if (m < best_m || (m == best_m && prefer_params(&trial, &best))) {
+                    best = trial;
+                    best_m = m;
+                    improved = 1;
+                    printf("  tile_w=%d tile_h=%d unroll=%d: misses=%llu\n",
+                           best.tile_w, best.tile_h, best.unroll, best_m);
+                }
+            }
+        }
+    } while (improved);
+
+    trial = best;
+    trial.carry = 1;
+    m = score_params(&trial, best_m);
+    evals++;
+    if (m < best_m) {
+        defaultShiftParams(M, N, s, E, b, &best);
+        best.carry = 1;
+        best_m = m;
+        printf("  column carry: misses=%llu\n", best_m);
+    }
+
+    /* The replay only models the kernel, so make sure it is correct */
+    int (*A)[N] = malloc(sizeof(int) * M * N);
+    int (*C)[N] = malloc(sizeof(int) * M * N);
+    assert(A && C);
+    initMatrix(M, N, A, seed);
+    memcpy(C, A, sizeof(int) * M * N);
+    shiftTiled(M, N, A, &best);
+    correctShift(M, N, C, s, E, b);
+    for (i = 0; i < M; i++) {
+        for (j = 0; j < N; j++) {
+            if (A[i][j] != C[i][j]) {
+                printf("Validation failed for the tuned parameters at A[%d][%d]\n", i, j);
+                exit(1);
+            }
+        }
+    }
+    free(A);
+    free(C);
+
+    printf("Best after %d evaluations: tile_w=%d tile_h=%d unroll=%d carry=%d misses=%llu\n",
+           evals, best.tile_w, best.tile_h, best.unroll, best.carry, best_m);
+
+    read_tuning_table(table_file);
+    for (i = 0; i < num_tuning_rows; i++) {
+        if (tuning_rows[i].M == M && tuning_rows[i].N == N && tuning_rows[i].s == s &&
+            tuning_rows[i].E == E && tuning_rows[i].b == b)
+            break;
+    }
+    if (i == MAX_TUNING_ROWS) {
+        printf("Error: %s already holds %d rows\n", table_file, MAX_TUNING_ROWS);
+        exit(1);
+    }
+    if (i == num_tuning_rows)
+        num_tuning_rows++;
+    tuning_rows[i].M = M;
+    tuning_rows[i].N = N;
+    tuning_rows[i].s = s;
+    tuning_rows[i].E = E;
+    tuning_rows[i].b = b;
+    tuning_rows[i].params = best;
+    tuning_misses[i] = best_m;
+    write_tuning_table(table_file);
+    printf("Updated %s; rebuild to use it in matrix_shift_tuned()\n", table_file);
+}
+
 /*
  * usage - Print usage info
  */
@@ -293,8 +799,19 @@ void usage(char *argv[]){
     printf("  -s <cols>   2 ^ s - Number of cache sets (for 512B cache %d and for 4KB cache %d)\n", 5, 8);
     printf("  -E <cols>   Set associativity of cache  (fixed at %d)\n", 2);
     printf("  -b <cols>   Number of bytes in a cache block (fixed at %d)\n", 3);
+    printf("  -S <seed>   Seed for the matrix contents (default %d)\n", DEFAULT_SEED);
+    printf("  -a <bytes>  Align the traced matrix to bytes (default 64, or 2^(s+b) with -o/-O)\n");
+    printf("  -o <bytes>  Place the traced matrix bytes past that alignment\n");
+    printf("  -O <sets>   Place the traced matrix this many cache sets past it\n");
+    printf("  -H <pages>  Back the traced matrix with default, thp or hugetlb pages\n");
+    printf("  -P <num>    Time the parallel shift natively with 1..num threads\n");
+    printf("  -B <num>    Benchmark every function natively, num runs each (0 for %d)\n", NATIVE_REPS);
+    printf("  -T <file>   Autotune the tiled shift for M, N, s, E, b and update <file>\n");
     printf("Example for 512Bytes cache size: %s -M 256 -N 256 -s 5 -E 2 -b 3 \n", argv[0]);
     printf("Example for 4KB cache size: %s -M 256 -N 256 -s 8 -E 2 -b 3 \n", argv[0]);
+    printf("Example for parallel timing: %s -M 1024 -N 1024 -P 8 \n", argv[0]);
+    printf("Example for native benchmark: %s -M 1024 -N 1024 -s 5 -E 2 -b 3 -B 101 \n", argv[0]);
+    printf("Example for autotuning: %s -M 128 -N 128 -s 5 -E 2 -b 3 -T shift-tuned.h \n", argv[0]);
 }
 
 /*
@@ -325,7 +842,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:s:E:b:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:s:E:b:S:a:o:O:H:P:B:T:h")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -342,6 +859,30 @@ int main(int argc, char* argv[])
 	case 'b':
             b = atoi(optarg);
             break;
+        case 'S':
+            seed = (unsigned int) strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+        case 'o':
+        case 'O':
+        case 'H':
+            if (strlen(layout_args) + strlen(optarg) + 5 >= sizeof(layout_args)) {
+                printf("Error: Too many layout options\n");
+                exit(1);
+            }
+            sprintf(layout_args + strlen(layout_args), " -%c %s", c, optarg);
+            break;
+        case 'P':
+            max_threads = atoi(optarg);
+            break;
+        case 'B':
+            native_reps = atoi(optarg);
+            if (native_reps <= 0)
+                native_reps = NATIVE_REPS;
+            break;
+        case 'T':
+            tune_file = optarg;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -363,6 +904,31 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    if (max_threads > 0) {
+        eval_parallel(max_threads);
+        return 0;
+    }
+
+    if (native_reps > 0) {
+        if (E == 0) {
+            printf("Error: The native benchmark needs -s, -E and -b\n");
+            usage(argv);
+            exit(1);
+        }
+        eval_native(native_reps);
+        return 0;
+    }
+
+    if (tune_file) {
+        if (E == 0) {
+            printf("Error: Autotuning needs -s, -E and -b\n");
+            usage(argv);
+            exit(1);
+        }
+        eval_tune(tune_file);
+        return 0;
+    }
+
     /* Install SIGSEGV and SIGALRM handlers */
     if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
         fprintf(stderr, "Unable to install SIGALRM handler\n");
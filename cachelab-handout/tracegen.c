@@ -4,9 +4,19 @@
  *
  * The beginning and end of each registered matrix wavefront function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, followed by the exact
+ * address ranges (matrices, the shift function's stack frames and any
+ * registered scratch buffers) whose accesses belong to the trace. The
+ * last line describes the layout the matrix was allocated with; it is
+ * informational, and test-shift prints it next to the miss counts so
+ * that results name the layout they were measured under.
+ *
+ * The matrix is allocated at runtime so that its base alignment, its
+ * offset from that alignment and the page size can be chosen on the
+ * command line instead of being left to the linker. Rows are always
+ * packed: the kernels take int A[M][N], so N is also the row stride.
  */
-
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -14,10 +24,15 @@
 #include <getopt.h>
 #include "cachelab.h"
 #include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 /* External variables declared in cachelab.c */
 extern shift_funct_t func_list[MAX_SHIFT_FUNCS];
 extern int func_counter;
+extern scratch_buf_t scratch_list[MAX_SCRATCH_BUFS];
+extern int scratch_counter;
 
 /* External function from shift.c */
 extern void registerFunctions();
@@ -25,31 +40,149 @@ extern void registerFunctions();
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
-static int A[1024][1024];
-static int C[1024][1024];
+/* Stack size assumed when RLIMIT_STACK is unlimited */
+#define DEFAULT_STACK_BYTES (8UL * 1024 * 1024)
+
+/* Size of a huge page for the -H allocations */
+#define HUGE_PAGE_BYTES (2UL * 1024 * 1024)
+
+static int *A;
 static int M;
 static int N;
 static int s;
 static int E;
 static int b;
+static unsigned int seed = DEFAULT_SEED;
+
+/* Matrix layout, set on the command line */
+static unsigned long int align = 0;     /* base alignment in bytes */
+static unsigned long int offset = 0;    /* bytes past the aligned base */
+static char *page_mode = "default";     /* default, thp or hugetlb */
+
+/*
+ * stackPointer - Return the stack pointer of the caller at the point of the
+ *     call. Our own frame address sits just below the return address and
+ *     the saved frame pointer, which is where the caller's stack ends.
+ */
+static __attribute__((noinline)) unsigned long long int stackPointer()
+{
+    return (unsigned long long int) __builtin_frame_address(0)
+        + 2 * sizeof(void*);
+}
 
-int check(int fn, int M, int N, int C[M][N], int A[M][N])
+/*
+ * stackBytes - How far the stack may grow, which bounds the shift
+ *     function's frames however deep it recurses or however much it
+ *     allocates there.
+ */
+static unsigned long long int stackBytes()
 {
-	for(int i=0;i<M;i++) {
-		for(int j=0;j<N;j++) {
-			if(C[i][j]!= A[i][j]) {
-				printf("Validation failed on function %d! Expected %d but got %d at A[%d][%d]\n",fn,C[i][j],A[i][j],i,j);
-				return 0;
-			}
-		}
-	}
-	return 1;
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_STACK, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY)
+        return DEFAULT_STACK_BYTES;
+    return (unsigned long long int) rl.rlim_cur;
+}
+
+/*
+ * writeMarkers - Record the marker addresses and the regions of interest.
+ *     Each region is written as "<start> <end> <name>" with end exclusive.
+ */
+void writeMarkers(unsigned long long int stack_top)
+{
+    int i;
+    unsigned long long int bytes = (unsigned long long int) sizeof(int) * M * N;
+    unsigned long long int stack_bytes = stackBytes();
+    FILE* marker_fp = fopen(".marker","w");
+    assert(marker_fp);
+    fprintf(marker_fp, "%llx %llx\n",
+            (unsigned long long int) &MARKER_START,
+            (unsigned long long int) &MARKER_END );
+    fprintf(marker_fp, "%llx %llx A\n",
+            (unsigned long long int) A, (unsigned long long int) A + bytes);
+    fprintf(marker_fp, "%llx %llx stack\n",
+            stack_bytes < stack_top ? stack_top - stack_bytes : 0, stack_top);
+    for (i = 0; i < scratch_counter; i++) {
+        fprintf(marker_fp, "%llx %llx scratch:%s\n",
+                (unsigned long long int) scratch_list[i].base,
+                (unsigned long long int) scratch_list[i].base + scratch_list[i].len,
+                scratch_list[i].description);
+    }
+    fprintf(marker_fp, "layout align=%lu offset=%lu set=%llu stride=%d pages=%s\n",
+            align, offset,
+            ((unsigned long long int) A >> b) & ((1ULL << s) - 1),
+            N * (int) sizeof(int), page_mode);
+    fclose(marker_fp);
+}
+
+/*
+ * allocMatrix - Allocate bytes for the matrix at `offset` bytes past an
+ *     `align`-byte boundary, backed by ordinary, transparent huge or
+ *     hugetlbfs pages. Falls back to transparent huge pages when no
+ *     hugetlbfs pages are reserved.
+ */
+int *allocMatrix(size_t bytes)
+{
+    size_t total = bytes + align + offset;
+    unsigned long int base;
+    char *raw;
+
+    if (strcmp(page_mode, "default") == 0) {
+        raw = malloc(total);
+        assert(raw);
+    } else {
+        total = (total + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+        raw = MAP_FAILED;
+        if (strcmp(page_mode, "hugetlb") == 0) {
+            raw = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (raw == MAP_FAILED) {
+                printf("MAP_HUGETLB failed (%s), using transparent huge pages\n",
+                       strerror(errno));
+                page_mode = "thp";
+            }
+        }
+        if (raw == MAP_FAILED) {
+            raw = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) {
+                printf("mmap of %zu bytes failed: %s\n", total, strerror(errno));
+                exit(1);
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(raw, total, MADV_HUGEPAGE);
+#endif
+        }
+    }
+
+    base = ((unsigned long int) raw + align - 1) & ~(align - 1);
+    return (int *) (base + offset);
 }
 
-int validate(int fn,int M, int N, int A[M][N], int s, int E, int b) {
-    correctShift(M,N,C,s,E,b);
+/*
+ * check - Compare A with the seeded matrix shifted `shifts` times. Only
+ *     the checksums are compared unless they differ, in which case the
+ *     first wrong element is reported.
+ */
+int check(int fn, int M, int N, int A[M][N], int shifts)
+{
+    int i, j, expected;
+
+    if (matrixChecksum(M, N, A) == expectedChecksum(M, N, seed, shifts))
+        return 1;
 
-    return check(fn, M,N,C,A);
+    for (i = 0; i < M; i++) {
+        for (j = 0; j < N; j++) {
+            expected = expectedValue(M, N, seed, shifts, i, j);
+            if (A[i][j] != expected) {
+                printf("Validation failed on function %d! Expected %d but got %d at A[%d][%d] (seed %u)\n",
+                       fn, expected, A[i][j], i, j, seed);
+                return 0;
+            }
+        }
+    }
+    printf("Validation failed on function %d! Checksum mismatch (seed %u)\n", fn, seed);
+    return 0;
 }
 
 int main(int argc, char* argv[]){
@@ -57,7 +190,8 @@ int main(int argc, char* argv[]){
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:s:E:b:F:")) != -1){
+    int offset_sets = -1;
+    while( (c=getopt(argc,argv,"M:N:s:E:b:F:S:a:o:O:H:")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -77,6 +211,21 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'S':
+            seed = (unsigned int) strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            align = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            offset = strtoul(optarg, NULL, 0);
+            break;
+        case 'O':
+            offset_sets = atoi(optarg);
+            break;
+        case 'H':
+            page_mode = optarg;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -85,37 +234,62 @@ int main(int argc, char* argv[]){
     }
 
 
+    /* An offset in cache sets is that many blocks */
+    if (offset_sets >= 0)
+        offset = (unsigned long int) offset_sets << b;
+
+    /* Unless told otherwise, an offset is taken from the start of a cache
+       way, so that -O k places A at set k rather than wherever the
+       allocator's 64-byte chunk happens to fall */
+    if (align == 0) {
+        align = 64;
+        if (offset && (1UL << (s + b)) > align)
+            align = 1UL << (s + b);
+    }
+
+    if (M < 1 || N < 1 || M > MAXN || N > MAXN) {
+        printf("./tracegen: M and N must be between 1 and %d\n", MAXN);
+        exit(1);
+    }
+    if (align < sizeof(int) || (align & (align - 1)) || offset % sizeof(int)) {
+        printf("./tracegen: alignment must be a power of two and offset a multiple of %d\n",
+               (int) sizeof(int));
+        exit(1);
+    }
+    if (strcmp(page_mode, "default") && strcmp(page_mode, "thp") &&
+        strcmp(page_mode, "hugetlb")) {
+        printf("./tracegen: unknown page mode %s\n", page_mode);
+        exit(1);
+    }
+
+    A = allocMatrix(sizeof(int) * M * N);
+    int (*mat)[N] = (int (*)[N]) A;
+
     /*  Register matrix wavefront functions */
     registerFunctions();
 
-    /* Fill A with data */
-    initMatrix(M, N, A);
-
-    /* making a copy of the initialized matrix, which can be used later for generating expected values */
-    memcpy(C, A, (sizeof(int) * M * N));
+    /* Fill A with data; expected values are recomputed from the seed */
+    initMatrix(M, N, mat, seed);
 
-    /* Record marker addresses */
-    FILE* marker_fp = fopen(".marker","w");
-    assert(marker_fp);
-    fprintf(marker_fp, "%llx %llx",
-            (unsigned long long int) &MARKER_START,
-            (unsigned long long int) &MARKER_END );
-    fclose(marker_fp);
+    /* The shift function's frames live below our stack pointer */
+    unsigned long long int stack_top = stackPointer();
 
     if (-1==selectedFunc) {
         /* Invoke registered matrix wavefront functions */
         for (i=0; i < func_counter; i++) {
             MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, s, E, b);
+            (*func_list[i].func_ptr)(M, N, mat, s, E, b);
             MARKER_END = 34;
-            if (!validate(i,M,N,A, s, E, b))
+            writeMarkers(stack_top);
+            if (!check(i, M, N, mat, i + 1))
                 return i+1;
         }
     } else {
         MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, s, E, b);
+        (*func_list[selectedFunc].func_ptr)(M, N, mat, s, E, b);
         MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A, s, E, b))
+        writeMarkers(stack_top);
+        if (!check(selectedFunc, M, N, mat, 1))
             return selectedFunc+1;
 
     }